@@ -0,0 +1,359 @@
+// pix_cexport.h
+// Writes frames as a C++ header of constexpr arrays, for the handheld and
+// microcontroller builds that link their sprites straight into flash.
+//
+// Pixel formats:
+//   RGBA8888  uint32_t 0xAABBGGRR (R, G, B, A bytes in memory on little-endian)
+//   RGB565    uint16_t; transparent pixels hold the COLOR_KEY value (magenta)
+//   INDEX8    uint8_t palette indices, with the palette as RGBA8888 and RGB565
+//   INDEX4    two indices per byte, left pixel in the high nibble (16 colours)
+//
+// With RLE every row is a list of spans in the pixel type: the number of
+// transparent pixels to skip, the number of pixels to copy, then those
+// pixels, repeated until the row's width is covered. rows[y] is the offset
+// of row y in the data, so a blitter can clip vertically and copy each span
+// straight to the screen; nothing is decoded at runtime. INDEX4 rows are
+// always stored whole.
+//
+// Identical frames share one array, and a FRAMES table points at every
+// frame's data.
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "pix_png.h"
+
+namespace pixcexport
+{
+    enum Format
+    {
+        FORMAT_RGBA8888 = 0,
+        FORMAT_RGB565,
+        FORMAT_INDEX8,
+        FORMAT_INDEX4,
+        FORMAT_COUNT
+    };
+
+    inline const char *formatName(Format f)
+    {
+        static const char *names[] = {"RGBA8888", "RGB565", "INDEX8", "INDEX4"};
+        return f < FORMAT_COUNT ? names[f] : "?";
+    }
+
+    const uint16_t COLOR_KEY = 0xF81F; // RGB565 magenta
+
+    inline uint16_t rgb565(uint32_t c)
+    {
+        uint32_t r = c & 0xFF, g = (c >> 8) & 0xFF, b = (c >> 16) & 0xFF;
+        return (uint16_t)((r >> 3) << 11 | (g >> 2) << 5 | b >> 3);
+    }
+
+    // A frame as packed RGBA (r in the low byte), or as indices into
+    // Options::palette
+    struct Frame
+    {
+        std::string name;
+        const uint32_t *rgba = nullptr;
+        const uint8_t *indices = nullptr;
+    };
+
+    struct Options
+    {
+        Format format = FORMAT_RGB565;
+        bool rle = false;
+        // Packed RGBA palette of indexed frames. When every frame is indexed
+        // the INDEX formats keep its slot numbers; otherwise the palette is
+        // built from the colours in use.
+        std::vector<uint32_t> palette;
+    };
+
+    // C++ identifier from a file name: "export/walk-cycle.h" -> walk_cycle
+    inline std::string identifier(const std::string &path)
+    {
+        size_t begin = path.find_last_of("/\\");
+        begin = begin == std::string::npos ? 0 : begin + 1;
+        size_t end = path.find('.', begin);
+        std::string id;
+        for (char c : path.substr(begin, end == std::string::npos ? std::string::npos : end - begin))
+            id += std::isalnum((unsigned char)c) ? c : '_';
+        if (id.empty() || std::isdigit((unsigned char)id[0]))
+            id = "sprite_" + id;
+        return id;
+    }
+
+    class Writer
+    {
+    public:
+        const std::string &error() const { return err; }
+
+        bool write(const std::string &path, uint32_t width, uint32_t height, const std::vector<Frame> &frames, const Options &options)
+        {
+            w = width;
+            h = height;
+            opt = options;
+            if (frames.empty() || !w || !h)
+                return fail("nothing to export");
+            if (!choosePalette(frames))
+                return false;
+
+            // encode every frame, sharing the arrays of identical ones
+            std::vector<std::vector<uint32_t>> data, rows;
+            std::vector<size_t> source(frames.size());
+            for (size_t i = 0; i < frames.size(); ++i)
+            {
+                std::vector<uint32_t> d, r;
+                encode(frames[i], d, r);
+                source[i] = data.size();
+                for (size_t k = 0; k < data.size(); ++k)
+                    if (data[k] == d)
+                        source[i] = k;
+                if (source[i] == data.size())
+                {
+                    data.push_back(std::move(d));
+                    rows.push_back(std::move(r));
+                }
+            }
+
+            std::ofstream out(path);
+            if (!out)
+                return fail("cannot open " + path);
+            std::string id = identifier(path);
+            const char *type = pixelType();
+            size_t largest = 0;
+            for (auto &d : data)
+                largest = std::max(largest, d.size());
+            const char *rowType = largest <= 0xFFFF ? "uint16_t" : "uint32_t";
+
+            out << "// " << id << ": " << frames.size() << " frames of " << w << "x" << h << ", "
+                << formatName(opt.format) << (useRLE() ? " with RLE rows" : "") << ".\n"
+                << "// Generated by the pixel editor (pix_cexport.h); edits will be overwritten.\n";
+            if (useRLE())
+                out << "// Each row: skip count, copy count, copied pixels; repeated until WIDTH\n"
+                    << "// pixels are covered. Frame::rows[y] is where row y starts in data.\n";
+            out << "#pragma once\n\n#include <cstdint>\n\nnamespace " << id << "\n{\n"
+                << "    inline constexpr int WIDTH = " << w << ";\n"
+                << "    inline constexpr int HEIGHT = " << h << ";\n"
+                << "    inline constexpr int FRAME_COUNT = " << frames.size() << ";\n"
+                << "    inline constexpr bool RLE = " << (useRLE() ? "true" : "false") << ";\n";
+            if (opt.format == FORMAT_RGB565)
+                out << "    inline constexpr uint16_t COLOR_KEY = " << hex(COLOR_KEY, 4) << "; // transparent\n";
+            if (indexed())
+            {
+                std::vector<uint32_t> p565;
+                for (uint32_t c : palette)
+                    p565.push_back(rgb565(c));
+                out << "\n    // 0xAABBGGRR\n";
+                array(out, "uint32_t", "PALETTE", palette, 8);
+                array(out, "uint16_t", "PALETTE_565", p565, 4);
+            }
+            out << "\n";
+            for (size_t k = 0; k < data.size(); ++k)
+            {
+                std::string name = "frame_" + std::to_string(k);
+                array(out, type, name, data[k], digits());
+                if (useRLE())
+                    array(out, rowType, name + "_rows", rows[k], 0);
+            }
+
+            out << "    struct Frame\n    {\n"
+                << "        const " << type << " *data;\n";
+            if (useRLE())
+                out << "        const " << rowType << " *rows;\n";
+            out << "        const char *name;\n    };\n\n"
+                << "    inline constexpr Frame FRAMES[FRAME_COUNT] = {\n";
+            for (size_t i = 0; i < frames.size(); ++i)
+            {
+                std::string name = "frame_" + std::to_string(source[i]);
+                out << "        {" << name << (useRLE() ? ", " + name + "_rows" : "") << ", " << quote(frames[i].name) << "},\n";
+            }
+            out << "    };\n}\n";
+            return (bool)out || fail("cannot write " + path);
+        }
+
+    private:
+        uint32_t w = 0, h = 0;
+        Options opt;
+        bool direct = false;           // frames' own indices are written
+        std::vector<uint32_t> palette; // INDEX formats
+        pixpng::Palette built;         // when the palette comes from the pixels
+        std::string err;
+
+        bool fail(const std::string &why)
+        {
+            err = why;
+            return false;
+        }
+
+        bool indexed() const { return opt.format == FORMAT_INDEX8 || opt.format == FORMAT_INDEX4; }
+        bool useRLE() const { return opt.rle && opt.format != FORMAT_INDEX4; }
+        size_t maxColors() const { return opt.format == FORMAT_INDEX4 ? 16 : 256; }
+
+        const char *pixelType() const
+        {
+            return opt.format == FORMAT_RGBA8888 ? "uint32_t" : opt.format == FORMAT_RGB565 ? "uint16_t" : "uint8_t";
+        }
+
+        // hex digits per value, also the largest span count
+        int digits() const { return opt.format == FORMAT_RGBA8888 ? 8 : opt.format == FORMAT_RGB565 ? 4 : 2; }
+
+        uint32_t rgbaAt(const Frame &f, size_t i) const
+        {
+            if (f.rgba)
+                return f.rgba[i];
+            return f.indices[i] < opt.palette.size() ? opt.palette[f.indices[i]] : 0;
+        }
+
+        bool choosePalette(const std::vector<Frame> &frames)
+        {
+            palette.clear();
+            built = pixpng::Palette();
+            direct = false;
+            if (!indexed())
+                return true;
+            size_t n = (size_t)w * h;
+            direct = std::all_of(frames.begin(), frames.end(), [](const Frame &f)
+                                 { return f.indices != nullptr; });
+            if (direct)
+            {
+                // keep the editor's slots, as far as the frames use them
+                size_t used = 0;
+                for (const Frame &f : frames)
+                    for (size_t i = 0; i < n; ++i)
+                        used = std::max(used, (size_t)f.indices[i] + 1);
+                if (used > maxColors())
+                    return fail("palette slot " + std::to_string(used - 1) + " is out of range for " + formatName(opt.format));
+                palette.assign(opt.palette.begin(), opt.palette.begin() + std::min(used, opt.palette.size()));
+                palette.resize(used, 0);
+                return true;
+            }
+            std::vector<uint32_t> px(n);
+            for (const Frame &f : frames)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    px[i] = rgbaAt(f, i);
+                built.add(px.data(), n);
+            }
+            built.finish();
+            if (!built.fits() || (size_t)built.size() > maxColors())
+                return fail(std::string("too many colours for ") + formatName(opt.format));
+            palette.assign(built.colors(), built.colors() + built.size());
+            return true;
+        }
+
+        // Pixel i as a value of the output format
+        uint32_t value(const Frame &f, size_t i) const
+        {
+            if (direct)
+                return f.indices[i];
+            uint32_t c = rgbaAt(f, i);
+            switch (opt.format)
+            {
+            case FORMAT_RGBA8888:
+                return c >> 24 ? c : 0;
+            case FORMAT_RGB565:
+            {
+                if (!(c >> 24))
+                    return COLOR_KEY;
+                uint16_t v = rgb565(c);
+                return v == COLOR_KEY ? COLOR_KEY ^ 1 : v; // keep opaque magenta visible
+            }
+            default:
+                return built.indexOf(c);
+            }
+        }
+
+        bool transparent(const Frame &f, size_t i) const { return !(rgbaAt(f, i) >> 24); }
+
+        void encode(const Frame &f, std::vector<uint32_t> &data, std::vector<uint32_t> &rows) const
+        {
+            if (opt.format == FORMAT_INDEX4)
+            {
+                for (uint32_t y = 0; y < h; ++y)
+                    for (uint32_t x = 0; x < w; x += 2)
+                    {
+                        size_t i = (size_t)y * w + x;
+                        data.push_back(value(f, i) << 4 | (x + 1 < w ? value(f, i + 1) : 0));
+                    }
+                return;
+            }
+            if (!useRLE())
+            {
+                for (size_t i = 0; i < (size_t)w * h; ++i)
+                    data.push_back(value(f, i));
+                return;
+            }
+
+            // a span may count at most this many pixels of each kind
+            uint32_t maxCount = digits() == 8 ? 0xFFFFFFFFu : (1u << (4 * digits())) - 1;
+            for (uint32_t y = 0; y < h; ++y)
+            {
+                rows.push_back((uint32_t)data.size());
+                size_t row = (size_t)y * w;
+                for (uint32_t x = 0; x < w;)
+                {
+                    uint32_t skip = 0, copy = 0;
+                    while (x + skip < w && transparent(f, row + x + skip))
+                        ++skip;
+                    while (x + skip + copy < w && !transparent(f, row + x + skip + copy))
+                        ++copy;
+                    for (; skip > maxCount; skip -= maxCount, x += maxCount)
+                    {
+                        data.push_back(maxCount);
+                        data.push_back(0);
+                    }
+                    do
+                    {
+                        uint32_t n = std::min(copy, maxCount);
+                        data.push_back(skip);
+                        data.push_back(n);
+                        x += skip;
+                        for (uint32_t k = 0; k < n; ++k)
+                            data.push_back(value(f, row + x + k));
+                        x += n;
+                        copy -= n;
+                        skip = 0;
+                    } while (copy);
+                }
+            }
+        }
+
+        static std::string hex(uint32_t v, int digits)
+        {
+            char buf[16];
+            std::snprintf(buf, sizeof(buf), "0x%0*X", digits, v);
+            return buf;
+        }
+
+        // digits = 0 writes decimal
+        static void array(std::ofstream &out, const char *type, const std::string &name, const std::vector<uint32_t> &v, int digits)
+        {
+            int perLine = digits == 8 ? 8 : digits == 4 ? 12 : 16;
+            out << "    inline constexpr " << type << " " << name << "[" << v.size() << "] = {";
+            for (size_t i = 0; i < v.size(); ++i)
+            {
+                out << (i % perLine ? " " : "\n        ") << (digits ? hex(v[i], digits) : std::to_string(v[i])) << ",";
+            }
+            out << "\n    };\n";
+        }
+
+        static std::string quote(const std::string &s)
+        {
+            std::string q = "\"";
+            for (char c : s)
+            {
+                if (c == '"' || c == '\\')
+                    q += '\\';
+                if ((unsigned char)c < 0x20)
+                    continue;
+                q += c;
+            }
+            return q + "\"";
+        }
+    };
+}
@@ -0,0 +1,116 @@
+// pix_delta.h
+// Inter-frame delta coding for the project files of both editors.
+//
+// Every KEY_INTERVAL-th frame is a keyframe; the frames after it are stored
+// as their XOR against that keyframe, so any frame decodes from at most two
+// records. Both kinds are run-length coded by pixel: a varint count of
+// unchanged (zero) pixels, a varint count of literal pixels, then the
+// literals. A walk cycle whose frames differ in a small region costs a few
+// hundred bytes per frame instead of a full bitmap.
+//
+// Pixels are opaque units of bpp bytes (4 for RGBA, 1 for palette indices).
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace pixdelta
+{
+    const uint32_t KEY_INTERVAL = 8;
+
+    enum Kind : uint8_t
+    {
+        KIND_KEY = 0,   // coded against zero
+        KIND_DELTA = 1, // coded against the most recent keyframe
+    };
+
+    inline bool isKey(size_t frame) { return frame % KEY_INTERVAL == 0; }
+
+    // Keyframe a frame is coded against
+    inline size_t keyOf(size_t frame) { return frame - frame % KEY_INTERVAL; }
+
+    inline void putVarint(std::vector<uint8_t> &out, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            out.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((uint8_t)v);
+    }
+
+    inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v)
+    {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (p == end)
+                return false;
+            uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    // Appends the coding of cur (pixels * bpp bytes) against ref, or against
+    // zero when ref is null
+    inline void encode(std::vector<uint8_t> &out, const uint8_t *cur, const uint8_t *ref, size_t pixels, int bpp)
+    {
+        auto same = [&](size_t i)
+        {
+            const uint8_t *c = cur + i * bpp;
+            if (ref)
+                return std::memcmp(c, ref + i * bpp, bpp) == 0;
+            for (int b = 0; b < bpp; ++b)
+                if (c[b])
+                    return false;
+            return true;
+        };
+        size_t i = 0;
+        while (i < pixels)
+        {
+            size_t run = i;
+            while (run < pixels && same(run))
+                ++run;
+            size_t lit = run;
+            while (lit < pixels && !same(lit))
+                ++lit;
+            putVarint(out, run - i);
+            putVarint(out, lit - run);
+            for (size_t k = run; k < lit; ++k)
+                for (int b = 0; b < bpp; ++b)
+                    out.push_back(cur[k * bpp + b] ^ (ref ? ref[k * bpp + b] : 0));
+            i = lit;
+        }
+    }
+
+    // Decodes into cur (pixels * bpp bytes) against ref, or zero when ref is
+    // null. False when the data is malformed or does not cover the frame.
+    inline bool decode(const uint8_t *in, size_t n, uint8_t *cur, const uint8_t *ref, size_t pixels, int bpp)
+    {
+        const uint8_t *p = in, *end = in + n;
+        size_t i = 0;
+        while (i < pixels)
+        {
+            uint64_t run, lit;
+            if (!getVarint(p, end, run) || !getVarint(p, end, lit))
+                return false;
+            if (run + lit == 0 || run > pixels - i || lit > pixels - i - run || (size_t)(end - p) < lit * bpp)
+                return false;
+            if (ref)
+                std::memcpy(cur + i * bpp, ref + i * bpp, (run + lit) * bpp);
+            else
+                std::memset(cur + i * bpp, 0, (run + lit) * bpp);
+            i += run;
+            for (size_t k = 0; k < lit * bpp; ++k)
+                cur[i * bpp + k] ^= p[k];
+            p += lit * bpp;
+            i += lit;
+        }
+        return p == end;
+    }
+}
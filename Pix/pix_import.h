@@ -0,0 +1,383 @@
+// pix_import.h
+// PNG import shared by the SDL (v1) and SFML (v7) editors: a sequence of
+// PNGs becomes one frame per file, a single spritesheet is sliced into
+// frames.
+//
+// Sequences are read and decoded in parallel on the job pool, each file
+// into a row-major buffer the caller hands out per frame (the SDL editor's
+// frame itself; the SFML editor's tiled frames copy from a short-lived
+// buffer instead). Sheets are sliced by a fixed cell size
+// or automatically: first along fully transparent gutter rows and columns,
+// and when there are none, by connected components of non-transparent
+// pixels (components whose boxes overlap are merged, so a detached sword
+// stays with its sprite). Automatic cells can differ in size; every frame
+// gets the size of the largest, with the sprite centred horizontally and
+// standing on the bottom edge so walk cycles keep their footing.
+//
+// Pixels are packed RGBA with r in the low byte, as everywhere else.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "pix_jobs.h"
+#include "pix_png.h"
+
+namespace piximport
+{
+    struct Rect
+    {
+        uint32_t x = 0, y = 0, w = 0, h = 0;
+    };
+
+    // Orders names ignoring case, with digit runs compared as numbers, so
+    // walk2.png comes before Walk10.png
+    inline bool naturalLess(const std::string &a, const std::string &b)
+    {
+        size_t i = 0, j = 0;
+        while (i < a.size() && j < b.size())
+        {
+            if (std::isdigit((unsigned char)a[i]) && std::isdigit((unsigned char)b[j]))
+            {
+                size_t i0 = i, j0 = j;
+                while (i0 < a.size() && a[i0] == '0')
+                    ++i0;
+                while (j0 < b.size() && b[j0] == '0')
+                    ++j0;
+                i = i0;
+                j = j0;
+                while (i < a.size() && std::isdigit((unsigned char)a[i]))
+                    ++i;
+                while (j < b.size() && std::isdigit((unsigned char)b[j]))
+                    ++j;
+                // longer run of significant digits is the bigger number
+                if (i - i0 != j - j0)
+                    return i - i0 < j - j0;
+                int c = a.compare(i0, i - i0, b, j0, j - j0);
+                if (c)
+                    return c < 0;
+                continue;
+            }
+            int ca = std::tolower((unsigned char)a[i]), cb = std::tolower((unsigned char)b[j]);
+            if (ca != cb)
+                return ca < cb;
+            ++i;
+            ++j;
+        }
+        return a.size() - i < b.size() - j;
+    }
+
+    // The PNGs to import from path: every .png in a directory in natural
+    // order, or path itself
+    inline std::vector<std::string> filesAt(const std::string &path)
+    {
+        namespace fs = std::filesystem;
+        std::vector<std::string> files;
+        std::error_code ec;
+        if (!fs::is_directory(path, ec))
+        {
+            if (fs::exists(path, ec))
+                files.push_back(path);
+            return files;
+        }
+        for (const auto &e : fs::directory_iterator(path, ec))
+        {
+            std::string ext = e.path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c)
+                           { return (char)std::tolower(c); });
+            if (ext == ".png" && e.is_regular_file(ec))
+                files.push_back(e.path().string());
+        }
+        std::sort(files.begin(), files.end(), naturalLess);
+        return files;
+    }
+
+    // One frame per file. Frames take the size of the largest image; smaller
+    // ones sit in the top-left corner.
+    class Sequence
+    {
+    public:
+        uint32_t width = 0, height = 0;
+
+        // Reads and checks every file's header, in parallel
+        bool open(const std::vector<std::string> &paths)
+        {
+            files = paths;
+            readers.clear();
+            readers.resize(files.size());
+            width = height = 0;
+            err.clear();
+            if (files.empty())
+                return fail("no PNG files");
+            std::atomic<bool> ok{true};
+            pixjobs::pool().parallelFor(pixjobs::PRIORITY_INTERACTIVE, files.size(), [&](size_t i)
+                                        {
+                if (!readers[i].open(files[i]))
+                    ok = false; }, "importOpen");
+            for (size_t i = 0; i < files.size(); ++i)
+            {
+                if (!ok && !readers[i].error().empty())
+                    return fail(files[i] + ": " + readers[i].error());
+                width = std::max(width, readers[i].getWidth());
+                height = std::max(height, readers[i].getHeight());
+            }
+            if ((uint64_t)width * height > pixpng::Reader::MAX_PIXELS)
+                return fail("frames too large");
+            return true;
+        }
+
+        size_t frames() const { return files.size(); }
+        const std::string &error() const { return err; }
+
+        // Decodes every file in parallel. target(i) gives a buffer for frame
+        // i (width * height pixels, row-major, zeroed); filled(i) then runs
+        // on the same worker once the buffer holds the image.
+        template <class Target, class Filled>
+        bool decode(Target &&target, Filled &&filled)
+        {
+            std::vector<char> failed(files.size(), 0);
+            pixjobs::pool().parallelFor(pixjobs::PRIORITY_INTERACTIVE, files.size(), [&](size_t i)
+                                        {
+                failed[i] = !readers[i].read(target(i), width);
+                if (!failed[i])
+                    filled(i); }, "importDecode");
+            readers.clear(); // drop the compressed data
+            for (size_t i = 0; i < files.size(); ++i)
+                if (failed[i])
+                    return fail(files[i] + ": corrupt image data");
+            return true;
+        }
+
+        template <class Target>
+        bool decode(Target &&target)
+        {
+            return decode(target, [](size_t) {});
+        }
+
+    private:
+        std::vector<std::string> files;
+        std::vector<pixpng::Reader> readers;
+        std::string err;
+
+        bool fail(const std::string &why)
+        {
+            err = why;
+            return false;
+        }
+    };
+
+    class Sheet
+    {
+    public:
+        uint32_t width = 0, height = 0;
+        std::vector<uint32_t> px;
+
+        bool load(const std::string &path)
+        {
+            pixpng::Reader png;
+            if (!png.open(path))
+                return fail(png.error());
+            width = png.getWidth();
+            height = png.getHeight();
+            px.assign((size_t)width * height, 0);
+            return png.read(px.data(), width) || fail(png.error());
+        }
+
+        const std::string &error() const { return err; }
+
+        // Frame rectangles in reading order: cellW x cellH cells, or detected
+        // automatically when either is 0. Fully transparent cells are skipped.
+        std::vector<Rect> slice(uint32_t cellW = 0, uint32_t cellH = 0) const
+        {
+            if (!cellW || !cellH)
+                return autoSlice();
+            std::vector<Rect> cells;
+            for (uint32_t y = 0; y + cellH <= height; y += cellH)
+                for (uint32_t x = 0; x + cellW <= width; x += cellW)
+                {
+                    Rect r{x, y, cellW, cellH};
+                    if (!blank(r))
+                        cells.push_back(r);
+                }
+            return cells;
+        }
+
+        // Frame size that holds every cell
+        static void frameSize(const std::vector<Rect> &cells, uint32_t &w, uint32_t &h)
+        {
+            w = h = 0;
+            for (const Rect &r : cells)
+            {
+                w = std::max(w, r.w);
+                h = std::max(h, r.h);
+            }
+        }
+
+        // Copies a cell into a zeroed w x h frame, centred on the bottom edge
+        void copy(const Rect &r, uint32_t *dst, uint32_t w, uint32_t h) const
+        {
+            uint32_t ox = (w - r.w) / 2, oy = h - r.h;
+            for (uint32_t y = 0; y < r.h; ++y)
+                std::memcpy(dst + (size_t)(oy + y) * w + ox, &px[(size_t)(r.y + y) * width + r.x], r.w * sizeof(uint32_t));
+        }
+
+    private:
+        std::string err;
+
+        bool fail(const std::string &why)
+        {
+            err = why;
+            return false;
+        }
+
+        bool opaque(uint32_t x, uint32_t y) const { return px[(size_t)y * width + x] >> 24; }
+
+        bool blank(const Rect &r) const
+        {
+            for (uint32_t y = r.y; y < r.y + r.h; ++y)
+                for (uint32_t x = r.x; x < r.x + r.w; ++x)
+                    if (opaque(x, y))
+                        return false;
+            return true;
+        }
+
+        // Maximal runs of used rows or columns, as [begin, end) pairs
+        static std::vector<std::pair<uint32_t, uint32_t>> runs(const std::vector<char> &used)
+        {
+            std::vector<std::pair<uint32_t, uint32_t>> out;
+            for (uint32_t i = 0; i < used.size();)
+            {
+                if (!used[i])
+                {
+                    ++i;
+                    continue;
+                }
+                uint32_t b = i;
+                while (i < used.size() && used[i])
+                    ++i;
+                out.emplace_back(b, i);
+            }
+            return out;
+        }
+
+        std::vector<Rect> autoSlice() const
+        {
+            // gutters: rows and columns without a single visible pixel
+            std::vector<char> rowUsed(height, 0), colUsed(width, 0);
+            for (uint32_t y = 0; y < height; ++y)
+                for (uint32_t x = 0; x < width; ++x)
+                    if (opaque(x, y))
+                        rowUsed[y] = colUsed[x] = 1;
+            auto bands = runs(rowUsed), strips = runs(colUsed);
+            std::vector<Rect> cells;
+            if (bands.size() * strips.size() > 1)
+            {
+                // a grid: cells in one column keep the same horizontal extent
+                for (auto &b : bands)
+                    for (auto &s : strips)
+                    {
+                        Rect r{s.first, b.first, s.second - s.first, b.second - b.first};
+                        if (!blank(r))
+                            cells.push_back(r);
+                    }
+                return cells;
+            }
+            if (bands.empty())
+                return cells;
+            cells = components();
+            order(cells);
+            return cells;
+        }
+
+        // Bounding boxes of 8-connected non-transparent regions, merged until
+        // no two overlap
+        std::vector<Rect> components() const
+        {
+            std::vector<Rect> boxes;
+            std::vector<char> seen(px.size(), 0);
+            std::vector<uint32_t> stack;
+            for (uint32_t y0 = 0; y0 < height; ++y0)
+                for (uint32_t x0 = 0; x0 < width; ++x0)
+                {
+                    size_t i0 = (size_t)y0 * width + x0;
+                    if (seen[i0] || !opaque(x0, y0))
+                        continue;
+                    uint32_t minX = x0, maxX = x0, minY = y0, maxY = y0;
+                    seen[i0] = 1;
+                    stack.assign(1, (uint32_t)i0);
+                    while (!stack.empty())
+                    {
+                        uint32_t i = stack.back();
+                        stack.pop_back();
+                        uint32_t x = i % width, y = i / width;
+                        minX = std::min(minX, x);
+                        maxX = std::max(maxX, x);
+                        minY = std::min(minY, y);
+                        maxY = std::max(maxY, y);
+                        for (int dy = -1; dy <= 1; ++dy)
+                            for (int dx = -1; dx <= 1; ++dx)
+                            {
+                                int64_t nx = (int64_t)x + dx, ny = (int64_t)y + dy;
+                                if (nx < 0 || ny < 0 || nx >= width || ny >= height)
+                                    continue;
+                                size_t n = (size_t)ny * width + (size_t)nx;
+                                if (!seen[n] && opaque((uint32_t)nx, (uint32_t)ny))
+                                {
+                                    seen[n] = 1;
+                                    stack.push_back((uint32_t)n);
+                                }
+                            }
+                    }
+                    boxes.push_back(Rect{minX, minY, maxX - minX + 1, maxY - minY + 1});
+                }
+
+            for (bool merged = true; merged;)
+            {
+                merged = false;
+                for (size_t a = 0; a < boxes.size(); ++a)
+                    for (size_t b = a + 1; b < boxes.size(); ++b)
+                    {
+                        Rect &p = boxes[a], &q = boxes[b];
+                        if (p.x >= q.x + q.w || q.x >= p.x + p.w || p.y >= q.y + q.h || q.y >= p.y + p.h)
+                            continue;
+                        uint32_t x1 = std::max(p.x + p.w, q.x + q.w), y1 = std::max(p.y + p.h, q.y + q.h);
+                        p.x = std::min(p.x, q.x);
+                        p.y = std::min(p.y, q.y);
+                        p.w = x1 - p.x;
+                        p.h = y1 - p.y;
+                        boxes.erase(boxes.begin() + b);
+                        merged = true;
+                        --b;
+                    }
+            }
+            return boxes;
+        }
+
+        // Reading order: rows of boxes whose vertical extents overlap, each
+        // row left to right
+        static void order(std::vector<Rect> &boxes)
+        {
+            std::sort(boxes.begin(), boxes.end(), [](const Rect &a, const Rect &b)
+                      { return a.y < b.y; });
+            for (size_t begin = 0; begin < boxes.size();)
+            {
+                size_t end = begin + 1;
+                uint32_t bottom = boxes[begin].y + boxes[begin].h;
+                while (end < boxes.size() && boxes[end].y < bottom)
+                {
+                    bottom = std::max(bottom, boxes[end].y + boxes[end].h);
+                    ++end;
+                }
+                std::sort(boxes.begin() + begin, boxes.begin() + end, [](const Rect &a, const Rect &b)
+                          { return a.x < b.x; });
+                begin = end;
+            }
+        }
+    };
+}
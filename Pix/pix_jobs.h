@@ -0,0 +1,288 @@
+// pix_jobs.h
+// Work-stealing job system for the editors' bulk work (export, save, resize,
+// thumbnails, upscaling).
+//
+// Every worker owns a deque per priority: it pops its own jobs LIFO and
+// steals other workers' jobs FIFO. Jobs submitted from outside the pool go
+// to a shared injection queue. Interactive jobs always run before
+// background ones, wherever they are queued.
+//
+// A job can be cancelled and can report progress. Its onDone callback runs
+// on the UI thread, from Pool::runCompletions(), so the callback may touch
+// editor state. Threads that wait on a job run other queued jobs meanwhile,
+// so nested parallelFor calls inside jobs cannot deadlock the pool.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "pix_trace.h"
+
+namespace pixjobs
+{
+    enum Priority
+    {
+        PRIORITY_INTERACTIVE = 0, // the UI is waiting on it
+        PRIORITY_BACKGROUND,      // exports, saves
+        PRIORITY_COUNT
+    };
+
+    class Job
+    {
+    public:
+        const char *name = "job"; // string literal, shown in traces
+        Priority priority = PRIORITY_BACKGROUND;
+        std::function<void(Job &)> run;
+        std::function<void(bool completed)> onDone;     // UI thread
+        std::function<void(float progress)> onProgress; // worker thread
+
+        std::atomic<bool> cancelled{false};
+        std::atomic<bool> finished{false};
+        std::atomic<float> progress{0.f};
+
+        void cancel() { cancelled = true; }
+        bool isCancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+        void setProgress(size_t done, size_t total)
+        {
+            progress = total ? (float)done / total : 1.f;
+            if (onProgress)
+                onProgress(progress);
+        }
+    };
+
+    typedef std::shared_ptr<Job> Handle;
+
+    class Pool
+    {
+    public:
+        // threads = 0 picks one less than the hardware threads (the UI thread
+        // helps out whenever it waits)
+        explicit Pool(unsigned threads = 0)
+        {
+            pixtrace::state(); // constructed first so it outlives the workers
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+            threads = std::max(1u, threads);
+            for (unsigned i = 0; i <= threads; ++i)
+                queues.emplace_back(new Queue);
+            for (unsigned i = 0; i < threads; ++i)
+                workers.emplace_back([this, i]()
+                                     { workerLoop((int)i); });
+        }
+
+        // Queued jobs still run before the workers exit, so a save submitted
+        // just before quitting reaches the disk
+        ~Pool()
+        {
+            {
+                std::lock_guard<std::mutex> g(sleepLock);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto &t : workers)
+                t.join();
+        }
+
+        unsigned threadCount() const { return (unsigned)workers.size(); }
+
+        Handle submit(Priority priority, const char *name, std::function<void(Job &)> run,
+                      std::function<void(bool)> onDone = nullptr, std::function<void(float)> onProgress = nullptr)
+        {
+            Handle job = std::make_shared<Job>();
+            job->name = name;
+            job->priority = priority;
+            job->run = std::move(run);
+            job->onDone = std::move(onDone);
+            job->onProgress = std::move(onProgress);
+
+            int self = workerSlot();
+            Queue &q = *queues[self >= 0 ? self : injection()];
+            {
+                std::lock_guard<std::mutex> g(q.lock);
+                q.jobs[priority].push_back(job);
+            }
+            ++queued;
+            {
+                std::lock_guard<std::mutex> g(sleepLock);
+            }
+            wake.notify_one();
+            return job;
+        }
+
+        // Blocks until the job has finished, running other jobs meanwhile.
+        // Only jobs at least as urgent as the awaited one are picked up, so
+        // waiting on a quick job never gets stuck behind a long export.
+        void wait(const Handle &job)
+        {
+            int self = workerSlot();
+            while (!job->finished)
+            {
+                if (runOne(self, job->priority))
+                    continue;
+                std::unique_lock<std::mutex> g(doneLock);
+                doneSignal.wait_for(g, std::chrono::milliseconds(1), [&]()
+                                    { return job->finished.load(); });
+            }
+        }
+
+        // Runs fn(i) for i in [0, count) across the pool and the calling
+        // thread, returning when every index is done
+        template <class Fn>
+        void parallelFor(Priority priority, size_t count, Fn &&fn, const char *name = "parallelFor")
+        {
+            if (count == 0)
+                return;
+            auto next = std::make_shared<std::atomic<size_t>>(0);
+            auto body = [next, count, &fn](Job &job)
+            {
+                for (size_t i = (*next)++; i < count && !job.isCancelled(); i = (*next)++)
+                    fn(i);
+            };
+            std::vector<Handle> helpers;
+            size_t n = std::min<size_t>(count - 1, workers.size());
+            for (size_t i = 0; i < n; ++i)
+                helpers.push_back(submit(priority, name, body));
+            Job self;
+            body(self);
+            for (auto &h : helpers)
+                wait(h);
+        }
+
+        // UI thread, once per frame: fires onDone for finished jobs
+        void runCompletions()
+        {
+            std::vector<Handle> ready;
+            {
+                std::lock_guard<std::mutex> g(doneLock);
+                ready.swap(completed);
+            }
+            for (auto &job : ready)
+                job->onDone(!job->isCancelled());
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex lock;
+            std::deque<Handle> jobs[PRIORITY_COUNT];
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues; // one per worker, then the injection queue
+        std::vector<std::thread> workers;
+        std::atomic<size_t> queued{0};
+        std::mutex sleepLock;
+        std::condition_variable wake;
+        bool stopping = false;
+        std::mutex doneLock;
+        std::condition_variable doneSignal;
+        std::vector<Handle> completed;
+
+        int injection() const { return (int)queues.size() - 1; }
+
+        // Index of the calling thread's queue in this pool, -1 outside it
+        int &workerSlot()
+        {
+            thread_local const Pool *owner = nullptr;
+            thread_local int slot = -1;
+            if (owner != this)
+            {
+                owner = this;
+                slot = -1;
+            }
+            return slot;
+        }
+
+        // Highest priority first, down to lowest
+        Handle take(int self, int lowest)
+        {
+            for (int p = 0; p <= lowest; ++p)
+            {
+                // own jobs newest first (still warm in cache)
+                if (self >= 0)
+                {
+                    Queue &q = *queues[self];
+                    std::lock_guard<std::mutex> g(q.lock);
+                    if (!q.jobs[p].empty())
+                    {
+                        Handle job = q.jobs[p].back();
+                        q.jobs[p].pop_back();
+                        return job;
+                    }
+                }
+                // then the injection queue and other workers, oldest first
+                for (int i = 0; i < (int)queues.size(); ++i)
+                {
+                    int victim = (injection() + i) % (int)queues.size();
+                    if (victim == self)
+                        continue;
+                    Queue &q = *queues[victim];
+                    std::lock_guard<std::mutex> g(q.lock);
+                    if (!q.jobs[p].empty())
+                    {
+                        Handle job = q.jobs[p].front();
+                        q.jobs[p].pop_front();
+                        return job;
+                    }
+                }
+            }
+            return nullptr;
+        }
+
+        bool runOne(int self, int lowest = PRIORITY_COUNT - 1)
+        {
+            if (queued == 0)
+                return false;
+            Handle job = take(self, lowest);
+            if (!job)
+                return false;
+            --queued;
+            if (!job->isCancelled())
+            {
+                pixtrace::Clock::time_point t0 = pixtrace::Clock::now();
+                job->run(*job);
+                if (pixtrace::enabled())
+                    pixtrace::record(job->name, t0, pixtrace::Clock::now());
+            }
+            {
+                std::lock_guard<std::mutex> g(doneLock);
+                job->finished = true;
+                if (job->onDone)
+                    completed.push_back(job);
+            }
+            doneSignal.notify_all();
+            return true;
+        }
+
+        void workerLoop(int index)
+        {
+            workerSlot() = index;
+            pixtrace::setThreadName("pool " + std::to_string(index));
+            for (;;)
+            {
+                if (runOne(index))
+                    continue;
+                std::unique_lock<std::mutex> g(sleepLock);
+                wake.wait(g, [&]()
+                          { return queued > 0 || stopping; });
+                if (stopping && queued == 0)
+                    return;
+            }
+        }
+    };
+
+    // Pool shared by the whole editor
+    inline Pool &pool()
+    {
+        static Pool p;
+        return p;
+    }
+}
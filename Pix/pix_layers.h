@@ -0,0 +1,244 @@
+// pix_layers.h
+// Ordered layer stacks over tiled RGBA planes (pix_tiles.h) and the
+// compositor that flattens them.
+//
+// Layers are listed bottom first, each with visibility, an opacity and a
+// blend mode (normal, multiply, add, screen; the separable modes of the
+// W3C compositing spec, applied source-over). The composite is an ordinary
+// plane, so everything downstream (textures, mips, thumbnails, exports,
+// saves) reads one flattened buffer and never sees the layers.
+//
+// Flattener::update() finds the tiles changed since its previous call by
+// pointer (pix_tiles.h: planes share a tile exactly when the pointers
+// match) and recomposites only those; a tile where one layer shows through
+// unchanged shares that layer's tile instead of copying it. Compositing
+// works on premultiplied float channels stored as separate planes, so each
+// pixel loop is straight-line arithmetic the compiler vectorizes, with the
+// blend mode picked once per layer rather than per pixel.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "pix_tiles.h"
+
+namespace pixlayer
+{
+    enum Blend
+    {
+        BLEND_NORMAL = 0,
+        BLEND_MULTIPLY,
+        BLEND_ADD,
+        BLEND_SCREEN,
+        BLEND_COUNT
+    };
+
+    inline const char *blendName(Blend b)
+    {
+        static const char *names[] = {"NORMAL", "MULTIPLY", "ADD", "SCREEN"};
+        return b < BLEND_COUNT ? names[b] : "?";
+    }
+
+    struct Layer
+    {
+        std::string name = "Layer";
+        bool visible = true;
+        uint8_t opacity = 255;
+        Blend blend = BLEND_NORMAL;
+        pixtile::Plane<uint32_t> px; // packed RGBA, r in the low byte
+
+        // Adds anything to the composite
+        bool shown() const { return visible && opacity > 0; }
+
+        // Composited over nothing, comes out as its own pixels
+        bool passThrough() const { return visible && opacity == 255 && blend == BLEND_NORMAL; }
+
+        bool sameLook(const Layer &o) const { return visible == o.visible && opacity == o.opacity && blend == o.blend; }
+
+        // Visibility, opacity and blend mode in one word for project files:
+        // bit 0 hidden, bits 8-15 opacity, bits 16-23 blend mode
+        uint32_t attrs() const { return (visible ? 0u : 1u) | (uint32_t)opacity << 8 | (uint32_t)blend << 16; }
+
+        void setAttrs(uint32_t a)
+        {
+            visible = !(a & 1);
+            opacity = (uint8_t)(a >> 8);
+            uint32_t b = (a >> 16) & 0xFF;
+            blend = b < BLEND_COUNT ? (Blend)b : BLEND_NORMAL;
+        }
+    };
+
+    // Composites one tile at a time: begin(), add() each layer's tile
+    // bottom first, then finish() into straight-alpha packed RGBA. The
+    // channels live in separate fixed planes so the compiler can see they
+    // never overlap and vectorize every loop without runtime checks.
+    class Compositor
+    {
+    public:
+        static const unsigned N = pixtile::TILE * pixtile::TILE;
+
+        void begin()
+        {
+            for (float *p : {acc[0], acc[1], acc[2], acc[3]})
+                std::fill(p, p + N, 0.f);
+        }
+
+        void add(const uint32_t *px, uint8_t opacity, Blend blend)
+        {
+            const float k = opacity / (255.f * 255.f), unit = 1.f / 255;
+            for (unsigned i = 0; i < N; ++i)
+            {
+                uint32_t c = px[i];
+                float a = (float)(c >> 24) * k;
+                src[0][i] = (float)(c & 0xFF) * unit * a;
+                src[1][i] = (float)((c >> 8) & 0xFF) * unit * a;
+                src[2][i] = (float)((c >> 16) & 0xFF) * unit * a;
+                src[3][i] = a;
+            }
+            switch (blend)
+            {
+            case BLEND_MULTIPLY:
+                mix([](float s, float d, float sa, float da)
+                    { return s * d + s * (1 - da) + d * (1 - sa); });
+                break;
+            case BLEND_ADD:
+                mix([](float s, float d, float sa, float da)
+                    { return s * (1 - da) + d * (1 - sa) + std::min(sa * da, s * da + d * sa); });
+                break;
+            case BLEND_SCREEN:
+                mix([](float s, float d, float, float)
+                    { return s + d - s * d; });
+                break;
+            default:
+                mix([](float s, float d, float sa, float)
+                    { return s + d * (1 - sa); });
+                break;
+            }
+        }
+
+        void finish(uint32_t *out) const
+        {
+            // premultiplied colour never exceeds alpha, so the quotients stay
+            // near 0..255; clamping the integers keeps the loop branch-free
+            auto byte = [](float v)
+            {
+                int b = (int)(v + 0.5f);
+                return (uint32_t)(b < 255 ? b : 255);
+            };
+            for (unsigned i = 0; i < N; ++i)
+            {
+                // clear pixels have no colour left, so the tiny bias gives 0
+                float a = acc[3][i];
+                float inv = 255.f / (a + 1e-30f);
+                out[i] = byte(acc[0][i] * inv) | byte(acc[1][i] * inv) << 8 | byte(acc[2][i] * inv) << 16 | byte(a * 255.f) << 24;
+            }
+        }
+
+    private:
+        float acc[4][N]; // premultiplied backdrop: r, g, b, a
+        float src[4][N]; // premultiplied layer being added
+
+        // Blends src into acc with f(source, backdrop, source alpha,
+        // backdrop alpha) per colour channel; alpha is always source-over
+        template <class F>
+        void mix(F f)
+        {
+            for (unsigned i = 0; i < N; ++i)
+            {
+                float sa = src[3][i], da = acc[3][i];
+                acc[0][i] = f(src[0][i], acc[0][i], sa, da);
+                acc[1][i] = f(src[1][i], acc[1][i], sa, da);
+                acc[2][i] = f(src[2][i], acc[2][i], sa, da);
+                acc[3][i] = sa + da * (1 - sa);
+            }
+        }
+    };
+
+    class Flattener
+    {
+    public:
+        // Brings flat up to date with layers (bottom first, all the same
+        // size), recompositing only the tiles where a layer changed since
+        // the previous call, or every tile when layers were added, removed,
+        // reordered or restyled. Returns how many tiles were recomposited.
+        size_t update(const std::vector<Layer> &layers, pixtile::Plane<uint32_t> &flat)
+        {
+            if (layers.empty())
+            {
+                clear();
+                return 0;
+            }
+            unsigned w = layers[0].px.getWidth(), h = layers[0].px.getHeight();
+            bool all = !sameStack(layers);
+            if (flat.empty() || flat.getWidth() != w || flat.getHeight() != h)
+            {
+                flat.create(w, h, 0);
+                all = true;
+            }
+
+            // a lone layer showing as-is is shared tile for tile
+            const Layer *only = nullptr;
+            int shown = 0;
+            for (const Layer &l : layers)
+                if (l.shown())
+                {
+                    only = &l;
+                    ++shown;
+                }
+            bool share = shown == 1 && only->passThrough();
+
+            // one compositor per thread: frames flatten in parallel on resize
+            thread_local std::unique_ptr<Compositor> comp(new Compositor);
+            thread_local std::vector<uint32_t> out(Compositor::N);
+            size_t n = 0;
+            for (unsigned ty = 0; ty < flat.tileRows(); ++ty)
+                for (unsigned tx = 0; tx < flat.tileCols(); ++tx)
+                {
+                    if (!all && !changed(layers, tx, ty))
+                        continue;
+                    ++n;
+                    if (share)
+                    {
+                        flat.shareTile(tx, ty, only->px);
+                        continue;
+                    }
+                    comp->begin();
+                    for (const Layer &l : layers)
+                        if (l.shown())
+                            comp->add(l.px.tile(tx, ty), l.opacity, l.blend);
+                    comp->finish(out.data());
+                    flat.setTile(tx, ty, out.data());
+                }
+            seen = layers;
+            return n;
+        }
+
+        // Forgets the stack last seen, so the next update recomposites all
+        void clear() { seen.clear(); }
+
+    private:
+        std::vector<Layer> seen; // copies keep the tiles compared against alive
+
+        bool sameStack(const std::vector<Layer> &layers) const
+        {
+            if (layers.size() != seen.size())
+                return false;
+            for (size_t i = 0; i < layers.size(); ++i)
+                if (!layers[i].sameLook(seen[i]) || layers[i].px.getWidth() != seen[i].px.getWidth() ||
+                    layers[i].px.getHeight() != seen[i].px.getHeight())
+                    return false;
+            return true;
+        }
+
+        bool changed(const std::vector<Layer> &layers, unsigned tx, unsigned ty) const
+        {
+            for (size_t i = 0; i < layers.size(); ++i)
+                if (layers[i].px.tile(tx, ty) != seen[i].px.tile(tx, ty))
+                    return true;
+            return false;
+        }
+    };
+}
@@ -0,0 +1,189 @@
+// pix_mip.h
+// Box-filtered mip chains of tiled RGBA planes (pix_tiles.h), for zoomed
+// out views, scrubbing proxies and thumbnails.
+//
+// Level 1 is half the plane's size (rounded up), each further level half
+// the one before, down to 1x1. A texel averages the up to 2x2 texels above
+// it weighted by their alpha, so transparent pixels neither darken nor
+// tint their neighbours; texels on the odd edge of a level average just
+// the texels that exist.
+//
+// update() finds the tiles changed since the previous update by pointer
+// (pix_tiles.h: planes share a tile exactly when the pointers match) and
+// re-filters only their footprint through each level: a 32x32 tile is
+// 16x16 texels in level 1, 8x8 in level 2 and so on. The chain keeps a
+// copy of the plane it last saw, which keeps those tiles alive so a new
+// tile can never reuse an old one's address.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "pix_tiles.h"
+
+namespace pixmip
+{
+    struct Level
+    {
+        unsigned width = 0, height = 0;
+        std::vector<uint32_t> px; // packed RGBA, r in the low byte
+    };
+
+    // Alpha-weighted average of n packed RGBA pixels; 0 when all are clear
+    inline uint32_t average(const uint32_t *const *px, int n)
+    {
+        uint32_t a = 0, r = 0, g = 0, b = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            uint32_t c = *px[i], w = c >> 24;
+            a += w;
+            r += (c & 0xFF) * w;
+            g += ((c >> 8) & 0xFF) * w;
+            b += ((c >> 16) & 0xFF) * w;
+        }
+        if (!a)
+            return 0;
+        return (r + a / 2) / a | ((g + a / 2) / a) << 8 | ((b + a / 2) / a) << 16 | ((a + n / 2) / n) << 24;
+    }
+
+    // Area-averaged resample of a w x h image to ow x oh, alpha-weighted
+    // like the chain. Enlarging picks the nearest pixel.
+    inline void resample(const uint32_t *src, unsigned w, unsigned h, uint32_t *dst, unsigned ow, unsigned oh)
+    {
+        std::vector<const uint32_t *> cell;
+        for (unsigned y = 0; y < oh; ++y)
+        {
+            unsigned y0 = y * h / oh, y1 = std::max(y0 + 1, (y + 1) * h / oh);
+            for (unsigned x = 0; x < ow; ++x)
+            {
+                unsigned x0 = x * w / ow, x1 = std::max(x0 + 1, (x + 1) * w / ow);
+                cell.clear();
+                for (unsigned sy = y0; sy < y1; ++sy)
+                    for (unsigned sx = x0; sx < x1; ++sx)
+                        cell.push_back(src + (size_t)sy * w + sx);
+                dst[(size_t)y * ow + x] = average(cell.data(), (int)cell.size());
+            }
+        }
+    }
+
+    class Chain
+    {
+    public:
+        // Levels below the source: level(1) .. level(levels())
+        int levels() const { return (int)chain.size(); }
+        const Level &level(int i) const { return chain[i - 1]; }
+
+        // Deepest level still at least w x h, or 0 when only the source is
+        unsigned levelFor(unsigned w, unsigned h) const
+        {
+            unsigned i = 0;
+            while (i < chain.size() && chain[i].width >= w && chain[i].height >= h)
+                ++i;
+            return i;
+        }
+
+        // Brings the chain up to date with plane, re-filtering only the
+        // tiles that changed since the previous call
+        void update(const pixtile::Plane<uint32_t> &plane)
+        {
+            using pixtile::TILE;
+            unsigned w = plane.getWidth(), h = plane.getHeight();
+            bool rebuild = w != seen.getWidth() || h != seen.getHeight() || seen.empty();
+            if (rebuild)
+                allocate(w, h);
+
+            // level 1 straight from the changed tiles; a tile's texels
+            // never straddle another tile's since TILE is even
+            std::vector<Rect> dirty;
+            for (unsigned ty = 0; ty < plane.tileRows(); ++ty)
+                for (unsigned tx = 0; tx < plane.tileCols(); ++tx)
+                {
+                    const uint32_t *t = plane.tile(tx, ty);
+                    if (!rebuild && t == seen.tile(tx, ty))
+                        continue;
+                    unsigned x0 = tx * TILE, y0 = ty * TILE;
+                    Rect r{x0 / 2, y0 / 2, (std::min(x0 + TILE, w) + 1) / 2, (std::min(y0 + TILE, h) + 1) / 2};
+                    if (!chain.empty())
+                        filterTile(t, x0, y0, w, h, r);
+                    dirty.push_back(r);
+                }
+            seen = plane;
+
+            // then each level from the one above, over the dirty footprint
+            for (size_t i = 1; i < chain.size() && !dirty.empty(); ++i)
+            {
+                for (Rect &r : dirty)
+                    r = {r.x0 / 2, r.y0 / 2, (r.x1 + 1) / 2, (r.y1 + 1) / 2};
+                // deep levels collapse many tiles onto the same texels
+                std::sort(dirty.begin(), dirty.end());
+                dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+                for (const Rect &r : dirty)
+                    filterLevel(chain[i - 1], chain[i], r);
+            }
+        }
+
+        // Drops the levels and the plane copy (e.g. when a frame goes indexed)
+        void clear()
+        {
+            chain.clear();
+            seen.release();
+        }
+
+    private:
+        struct Rect
+        {
+            unsigned x0, y0, x1, y1;
+            bool operator<(const Rect &o) const { return x0 != o.x0 ? x0 < o.x0 : y0 != o.y0 ? y0 < o.y0 : x1 != o.x1 ? x1 < o.x1 : y1 < o.y1; }
+            bool operator==(const Rect &o) const { return x0 == o.x0 && y0 == o.y0 && x1 == o.x1 && y1 == o.y1; }
+        };
+
+        std::vector<Level> chain;
+        pixtile::Plane<uint32_t> seen; // the plane as of the last update
+
+        void allocate(unsigned w, unsigned h)
+        {
+            chain.clear();
+            while (w > 1 || h > 1)
+            {
+                w = (w + 1) / 2;
+                h = (h + 1) / 2;
+                chain.emplace_back();
+                chain.back().width = w;
+                chain.back().height = h;
+                chain.back().px.assign((size_t)w * h, 0);
+            }
+        }
+
+        // Level 1 texels r from one source tile at (x0, y0) of a w x h plane
+        void filterTile(const uint32_t *tile, unsigned x0, unsigned y0, unsigned w, unsigned h, const Rect &r)
+        {
+            using pixtile::TILE;
+            Level &out = chain[0];
+            const uint32_t *cell[4];
+            for (unsigned y = r.y0; y < r.y1; ++y)
+                for (unsigned x = r.x0; x < r.x1; ++x)
+                {
+                    int n = 0;
+                    for (unsigned sy = 2 * y; sy < std::min(2 * y + 2, h); ++sy)
+                        for (unsigned sx = 2 * x; sx < std::min(2 * x + 2, w); ++sx)
+                            cell[n++] = tile + (sy - y0) * TILE + (sx - x0);
+                    out.px[(size_t)y * out.width + x] = average(cell, n);
+                }
+        }
+
+        static void filterLevel(const Level &in, Level &out, const Rect &r)
+        {
+            const uint32_t *cell[4];
+            for (unsigned y = r.y0; y < r.y1; ++y)
+                for (unsigned x = r.x0; x < r.x1; ++x)
+                {
+                    int n = 0;
+                    for (unsigned sy = 2 * y; sy < std::min(2 * y + 2, in.height); ++sy)
+                        for (unsigned sx = 2 * x; sx < std::min(2 * x + 2, in.width); ++sx)
+                            cell[n++] = &in.px[(size_t)sy * in.width + sx];
+                    out.px[(size_t)y * out.width + x] = average(cell, n);
+                }
+        }
+    };
+}
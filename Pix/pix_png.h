@@ -0,0 +1,1115 @@
+// pix_png.h
+// Streaming PNG writer and PNG reader shared by the SDL (v1) and SFML (v7)
+// editors.
+//
+// Rows are filtered, deflated and flushed to disk as they arrive, so callers
+// can produce very large images (upscaled sheets, long strips) while holding
+// only the current and previous scanline in memory.
+//
+// Images of at most 256 colours are written as 1/2/4/8-bit palette PNGs with
+// a tRNS chunk (Palette, writeImage), typically several times smaller than
+// the same pixels as RGBA.
+//
+// Reader decodes any standard PNG (all colour types and bit depths, Adam7)
+// straight into a caller's packed RGBA buffer, for importing art.
+//
+// Header-only; include it from any translation unit that needs it.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace pixpng
+{
+    enum ColorType
+    {
+        COLOR_GRAY = 0,
+        COLOR_RGB = 2,
+        COLOR_PALETTE = 3,
+        COLOR_GRAY_ALPHA = 4,
+        COLOR_RGBA = 6
+    };
+
+    inline uint32_t crc32(uint32_t crc, const uint8_t *p, size_t n)
+    {
+        struct Table
+        {
+            uint32_t v[256];
+            Table()
+            {
+                for (uint32_t i = 0; i < 256; ++i)
+                {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; ++k)
+                        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    v[i] = c;
+                }
+            }
+        };
+        static const Table t; // thread-safe one-time init
+        const uint32_t *table = t.v;
+        crc = ~crc;
+        for (size_t i = 0; i < n; ++i)
+            crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    // Incremental zlib stream using a single fixed-Huffman deflate block with
+    // LZ77 matching over a 32K sliding window (same scheme as stb_image_write,
+    // but fed in pieces instead of one buffer).
+    class ZStream
+    {
+    public:
+        std::vector<uint8_t> out; // compressed bytes not yet taken by the caller
+
+        void begin()
+        {
+            out.clear();
+            hist.clear();
+            base = 0;
+            bitbuf = 0;
+            bitcount = 0;
+            adlerA = 1;
+            adlerB = 0;
+            head.assign(HASH_SIZE, -1);
+            prev.assign(WINDOW, -1);
+            out.push_back(0x78);
+            out.push_back(0x5e);
+            putBits(1, 1); // BFINAL
+            putBits(1, 2); // BTYPE = fixed Huffman
+        }
+
+        void write(const uint8_t *data, size_t n)
+        {
+            for (size_t i = 0; i < n;)
+            {
+                // 5552 is the largest run that cannot overflow before the modulo
+                size_t run = std::min<size_t>(n - i, 5552);
+                for (size_t k = 0; k < run; ++k)
+                {
+                    adlerA += data[i + k];
+                    adlerB += adlerA;
+                }
+                adlerA %= 65521;
+                adlerB %= 65521;
+                i += run;
+            }
+
+            // Drop history that can no longer be referenced
+            if (hist.size() > 3 * WINDOW)
+            {
+                size_t drop = hist.size() - WINDOW;
+                hist.erase(hist.begin(), hist.begin() + drop);
+                base += (int64_t)drop;
+            }
+
+            int64_t pos = base + (int64_t)hist.size();
+            hist.insert(hist.end(), data, data + n);
+            int64_t end = base + (int64_t)hist.size();
+
+            while (pos < end)
+            {
+                int bestLen = 0;
+                int64_t bestDist = 0;
+                if (end - pos >= 3)
+                {
+                    int maxLen = (int)std::min<int64_t>(258, end - pos);
+                    const uint8_t *cur = &hist[(size_t)(pos - base)];
+                    int chain = 0;
+                    for (int64_t cand = head[hash(cur)]; cand >= 0 && chain < MAX_CHAIN; cand = prev[cand & (WINDOW - 1)], ++chain)
+                    {
+                        int64_t dist = pos - cand;
+                        if (dist <= 0 || dist > WINDOW || cand < base)
+                            break;
+                        const uint8_t *m = &hist[(size_t)(cand - base)];
+                        int len = 0;
+                        while (len < maxLen && m[len] == cur[len])
+                            ++len;
+                        if (len > bestLen)
+                        {
+                            bestLen = len;
+                            bestDist = dist;
+                            if (len == maxLen)
+                                break;
+                        }
+                    }
+                }
+
+                if (bestLen >= 3)
+                {
+                    for (int k = 0; k < bestLen; ++k)
+                        insert(pos + k, end);
+                    putLength(bestLen);
+                    putDistance((int)bestDist);
+                    pos += bestLen;
+                }
+                else
+                {
+                    insert(pos, end);
+                    putSymbol(hist[(size_t)(pos - base)]);
+                    ++pos;
+                }
+            }
+        }
+
+        void finish()
+        {
+            putSymbol(256);
+            if (bitcount > 0)
+                putBits(0, 8 - bitcount);
+            out.push_back((uint8_t)(adlerB >> 8));
+            out.push_back((uint8_t)adlerB);
+            out.push_back((uint8_t)(adlerA >> 8));
+            out.push_back((uint8_t)adlerA);
+        }
+
+    private:
+        static const int WINDOW = 32768;
+        static const int HASH_SIZE = 1 << 15;
+        static const int MAX_CHAIN = 16;
+
+        std::vector<uint8_t> hist;
+        int64_t base = 0; // absolute stream offset of hist[0]
+        std::vector<int64_t> head, prev;
+        uint32_t bitbuf = 0;
+        int bitcount = 0;
+        uint32_t adlerA = 1, adlerB = 0;
+
+        static unsigned hash(const uint8_t *p)
+        {
+            uint32_t h = p[0] | (p[1] << 8) | (p[2] << 16);
+            return (h * 2654435761u) >> 17;
+        }
+
+        void insert(int64_t pos, int64_t end)
+        {
+            if (end - pos < 3)
+                return;
+            unsigned h = hash(&hist[(size_t)(pos - base)]);
+            prev[pos & (WINDOW - 1)] = head[h];
+            head[h] = pos;
+        }
+
+        void putBits(uint32_t v, int n)
+        {
+            bitbuf |= v << bitcount;
+            bitcount += n;
+            while (bitcount >= 8)
+            {
+                out.push_back((uint8_t)bitbuf);
+                bitbuf >>= 8;
+                bitcount -= 8;
+            }
+        }
+
+        void putCode(uint32_t code, int n)
+        {
+            // Huffman codes are stored MSB first
+            uint32_t r = 0;
+            for (int i = 0; i < n; ++i)
+                r |= ((code >> i) & 1) << (n - 1 - i);
+            putBits(r, n);
+        }
+
+        void putSymbol(int s)
+        {
+            if (s <= 143)
+                putCode(0x30 + s, 8);
+            else if (s <= 255)
+                putCode(0x190 + s - 144, 9);
+            else if (s <= 279)
+                putCode(s - 256, 7);
+            else
+                putCode(0xc0 + s - 280, 8);
+        }
+
+        void putLength(int len)
+        {
+            static const uint16_t lengthc[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 259};
+            static const uint8_t lengtheb[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+            int i = 0;
+            while (len >= lengthc[i + 1])
+                ++i;
+            putSymbol(257 + i);
+            if (lengtheb[i])
+                putBits(len - lengthc[i], lengtheb[i]);
+        }
+
+        void putDistance(int dist)
+        {
+            static const uint16_t distc[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32769};
+            static const uint8_t disteb[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+            int i = 0;
+            while (dist >= distc[i + 1])
+                ++i;
+            putCode(i, 5);
+            if (disteb[i])
+                putBits(dist - distc[i], disteb[i]);
+        }
+    };
+
+    // The distinct colours of an image, for writing it as an indexed PNG.
+    // Pixels are packed RGBA (r in the low byte). Fully transparent pixels
+    // share one entry whatever their RGB, and translucent entries sort
+    // first so the tRNS chunk stays short.
+    class Palette
+    {
+    public:
+        static constexpr int MAX = 256;
+
+        Palette() { slots.assign(SLOTS, EMPTY); }
+
+        // Adds the colours of n pixels; false once there are more than MAX
+        bool add(const uint32_t *px, size_t n)
+        {
+            for (size_t i = 0; i < n && !overflow; ++i)
+            {
+                uint32_t c = key(px[i]);
+                // pixel art is mostly runs of one colour
+                if (haveLast && c == last)
+                    continue;
+                last = c;
+                haveLast = true;
+                int &s = slots[find(c)];
+                if (s != EMPTY)
+                    continue;
+                if ((int)entries.size() == MAX)
+                    overflow = true;
+                else
+                {
+                    s = (int)entries.size();
+                    entries.push_back(c);
+                }
+            }
+            return !overflow;
+        }
+
+        // Orders the entries; call once every pixel has been added
+        void finish()
+        {
+            std::stable_sort(entries.begin(), entries.end(), [](uint32_t a, uint32_t b)
+                             { return (a >> 24 != 255) > (b >> 24 != 255); });
+            for (size_t i = 0; i < entries.size(); ++i)
+                slots[find(entries[i])] = (int)i;
+        }
+
+        bool fits() const { return !overflow && !entries.empty(); }
+        int size() const { return (int)entries.size(); }
+        const uint32_t *colors() const { return entries.data(); }
+
+        // Smallest PNG bit depth that can index every entry
+        int bitDepth() const
+        {
+            return entries.size() <= 2 ? 1 : entries.size() <= 4 ? 2 : entries.size() <= 16 ? 4 : 8;
+        }
+
+        uint8_t indexOf(uint32_t c) const { return (uint8_t)slots[find(key(c))]; }
+
+        // Packs n pixels into a scanline at bitDepth(), leftmost pixel in the
+        // high bits as PNG requires
+        void pack(const uint32_t *px, size_t n, uint8_t *row) const
+        {
+            int depth = bitDepth();
+            if (depth == 8)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    row[i] = indexOf(px[i]);
+                return;
+            }
+            int perByte = 8 / depth;
+            std::memset(row, 0, (n * depth + 7) / 8);
+            for (size_t i = 0; i < n; ++i)
+                row[i / perByte] |= (uint8_t)(indexOf(px[i]) << (8 - depth * (int)(i % perByte + 1)));
+        }
+
+    private:
+        static constexpr int SLOTS = 2 * MAX; // open addressing, at most half full
+        static constexpr int EMPTY = -1;
+        std::vector<int> slots;       // index into entries, or EMPTY
+        std::vector<uint32_t> entries;
+        uint32_t last = 0;
+        bool haveLast = false, overflow = false;
+
+        static uint32_t key(uint32_t c) { return (c >> 24) ? c : 0; }
+
+        size_t find(uint32_t c) const
+        {
+            size_t i = (c * 2654435761u) >> 23;
+            while (slots[i] != EMPTY && entries[slots[i]] != c)
+                i = (i + 1) & (SLOTS - 1);
+            return i;
+        }
+    };
+
+    // Writes a PNG one scanline at a time. Rows are passed unfiltered in the
+    // packed layout of the chosen color type / bit depth; the writer picks a
+    // filter per row with the usual minimum-sum-of-absolute-differences rule.
+    // Indexed and sub-byte rows are left unfiltered: their samples are not
+    // intensities, so predicting them only breaks up the long runs of equal
+    // bytes that pixel art deflates so well.
+    class Writer
+    {
+    public:
+        ~Writer() { close(); }
+
+        // palette/trns are only used for COLOR_PALETTE; entries are packed RGBA
+        // (r in the low byte), the same layout the editors use for pixels.
+        bool open(const std::string &path, uint32_t w, uint32_t h, int bitDepth, ColorType type,
+                  const uint32_t *palette = nullptr, int paletteSize = 0)
+        {
+            close();
+            ofs.open(path, std::ios::binary);
+            if (!ofs)
+                return false;
+            width = w;
+            height = h;
+            rowsWritten = 0;
+            int channels = type == COLOR_RGBA ? 4 : type == COLOR_RGB ? 3 : type == COLOR_GRAY_ALPHA ? 2 : 1;
+            rowBytes = ((size_t)w * channels * bitDepth + 7) / 8;
+            bpp = std::max(1, channels * bitDepth / 8);
+            filters = type == COLOR_PALETTE || bitDepth < 8 ? 1 : 5;
+            colors = nullptr;
+            prevRow.assign(rowBytes, 0);
+            for (auto &c : cand)
+                c.assign(rowBytes + 1, 0);
+
+            static const uint8_t sig[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+            ofs.write((const char *)sig, 8);
+
+            uint8_t ihdr[13];
+            put32(ihdr, w);
+            put32(ihdr + 4, h);
+            ihdr[8] = (uint8_t)bitDepth;
+            ihdr[9] = (uint8_t)type;
+            ihdr[10] = ihdr[11] = ihdr[12] = 0;
+            chunk("IHDR", ihdr, 13);
+
+            if (type == COLOR_PALETTE && palette && paletteSize > 0)
+            {
+                std::vector<uint8_t> plte, trns;
+                int lastOpaque = -1;
+                for (int i = 0; i < paletteSize; ++i)
+                {
+                    uint32_t c = palette[i];
+                    plte.push_back((uint8_t)c);
+                    plte.push_back((uint8_t)(c >> 8));
+                    plte.push_back((uint8_t)(c >> 16));
+                    trns.push_back((uint8_t)(c >> 24));
+                    if ((c >> 24) != 255)
+                        lastOpaque = i;
+                }
+                chunk("PLTE", plte.data(), plte.size());
+                // tRNS may stop at the last translucent entry
+                if (lastOpaque >= 0)
+                    chunk("tRNS", trns.data(), (size_t)lastOpaque + 1);
+            }
+
+            z.begin();
+            return true;
+        }
+
+        // Opens for packed RGBA pixels fed through writePixels(): indexed at
+        // the smallest bit depth when colors holds the whole image's colours
+        // (finished, and kept alive until close()), 8-bit RGBA otherwise
+        bool open(const std::string &path, uint32_t w, uint32_t h, const Palette *colors)
+        {
+            bool indexed = colors && colors->fits();
+            bool ok = indexed ? open(path, w, h, colors->bitDepth(), COLOR_PALETTE, colors->colors(), colors->size())
+                              : open(path, w, h, 8, COLOR_RGBA);
+            if (indexed)
+            {
+                this->colors = colors;
+                packed.resize(rowBytes);
+            }
+            return ok;
+        }
+
+        // One row of width packed RGBA pixels, after the Palette open()
+        bool writePixels(const uint32_t *px)
+        {
+            if (!colors)
+                return writeRow((const uint8_t *)px);
+            colors->pack(px, width, packed.data());
+            return writeRow(packed.data());
+        }
+
+        bool writeRow(const uint8_t *row)
+        {
+            if (!ofs.is_open() || rowsWritten >= height)
+                return false;
+
+            int best = 0;
+            uint64_t bestScore = ~0ull;
+            for (int f = 0; f < filters; ++f)
+            {
+                uint8_t *o = cand[f].data();
+                o[0] = (uint8_t)f;
+                uint64_t score = 0;
+                for (size_t i = 0; i < rowBytes; ++i)
+                {
+                    int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+                    int b = rowsWritten ? prevRow[i] : 0;
+                    int c = (i >= (size_t)bpp && rowsWritten) ? prevRow[i - bpp] : 0;
+                    int pred = 0;
+                    switch (f)
+                    {
+                    case 1: pred = a; break;
+                    case 2: pred = b; break;
+                    case 3: pred = (a + b) >> 1; break;
+                    case 4: pred = paeth(a, b, c); break;
+                    }
+                    uint8_t v = (uint8_t)(row[i] - pred);
+                    o[i + 1] = v;
+                    score += (uint64_t)std::abs((int)(int8_t)v);
+                }
+                if (score < bestScore)
+                {
+                    bestScore = score;
+                    best = f;
+                }
+            }
+
+            z.write(cand[best].data(), rowBytes + 1);
+            std::memcpy(prevRow.data(), row, rowBytes);
+            ++rowsWritten;
+
+            if (z.out.size() >= 1 << 16)
+                flushIdat();
+            return (bool)ofs;
+        }
+
+        bool close()
+        {
+            if (!ofs.is_open())
+                return false;
+            bool complete = rowsWritten == height;
+            if (complete)
+            {
+                z.finish();
+                flushIdat();
+                chunk("IEND", nullptr, 0);
+            }
+            bool ok = complete && (bool)ofs;
+            ofs.close();
+            return ok;
+        }
+
+    private:
+        std::ofstream ofs;
+        uint32_t width = 0, height = 0, rowsWritten = 0;
+        size_t rowBytes = 0;
+        int bpp = 1;
+        int filters = 5; // candidates tried per row, from None upwards
+        const Palette *colors = nullptr;
+        std::vector<uint8_t> packed; // writePixels() row in palette form
+        std::vector<uint8_t> prevRow;
+        std::vector<uint8_t> cand[5];
+        ZStream z;
+
+        static void put32(uint8_t *p, uint32_t v)
+        {
+            p[0] = (uint8_t)(v >> 24);
+            p[1] = (uint8_t)(v >> 16);
+            p[2] = (uint8_t)(v >> 8);
+            p[3] = (uint8_t)v;
+        }
+
+        static int paeth(int a, int b, int c)
+        {
+            int p = a + b - c;
+            int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            if (pa <= pb && pa <= pc)
+                return a;
+            return pb <= pc ? b : c;
+        }
+
+        void chunk(const char *type, const uint8_t *data, size_t n)
+        {
+            uint8_t len[4];
+            put32(len, (uint32_t)n);
+            ofs.write((const char *)len, 4);
+            ofs.write(type, 4);
+            if (n)
+                ofs.write((const char *)data, n);
+            uint32_t crc = crc32(0, (const uint8_t *)type, 4);
+            if (n)
+                crc = crc32(crc, data, n);
+            uint8_t c[4];
+            put32(c, crc);
+            ofs.write((const char *)c, 4);
+        }
+
+        void flushIdat()
+        {
+            if (z.out.empty())
+                return;
+            chunk("IDAT", z.out.data(), z.out.size());
+            z.out.clear();
+        }
+    };
+
+    // Writes a packed RGBA image (stride in pixels), indexed when it has at
+    // most 256 colours
+    inline bool writeImage(const std::string &path, const uint32_t *px, uint32_t w, uint32_t h, size_t stride)
+    {
+        Palette colors;
+        for (uint32_t y = 0; y < h; ++y)
+            colors.add(px + y * stride, w);
+        colors.finish();
+        Writer png;
+        if (!png.open(path, w, h, &colors))
+            return false;
+        for (uint32_t y = 0; y < h; ++y)
+            if (!png.writePixels(px + y * stride))
+                return false;
+        return png.close();
+    }
+
+    // zlib decompression (stored, fixed and dynamic Huffman blocks) into a
+    // buffer of known size; anything that would overrun it is an error
+    class Inflater
+    {
+    public:
+        bool inflate(const uint8_t *data, size_t size, uint8_t *dst, size_t dstSize)
+        {
+            in = data;
+            n = size;
+            pos = 0;
+            bitbuf = 0;
+            bitcount = 0;
+            out = dst;
+            outSize = dstSize;
+            outPos = 0;
+
+            uint32_t cmf, flg;
+            if (!bits(8, cmf) || !bits(8, flg) || (cmf & 0x0F) != 8 || ((cmf << 8) | flg) % 31 || (flg & 0x20))
+                return false;
+            uint32_t last = 0;
+            while (!last)
+            {
+                uint32_t type;
+                if (!bits(1, last) || !bits(2, type))
+                    return false;
+                bool ok = type == 0 ? stored() : type == 1 ? fixed() : type == 2 ? dynamic() : false;
+                if (!ok)
+                    return false;
+            }
+            return outPos == outSize; // the Adler-32 trailer is not checked
+        }
+
+    private:
+        static const int FAST_BITS = 9;
+
+        struct Huffman
+        {
+            uint16_t counts[16];      // codes per length
+            uint16_t symbols[288];    // in canonical order
+            uint16_t fast[1 << FAST_BITS]; // (length << 9 | symbol) for short codes, 0 = slow path
+        };
+
+        const uint8_t *in = nullptr;
+        size_t n = 0, pos = 0;
+        uint64_t bitbuf = 0;
+        int bitcount = 0;
+        uint8_t *out = nullptr;
+        size_t outSize = 0, outPos = 0;
+        Huffman lit, dist;
+
+        void refill()
+        {
+            while (bitcount <= 56 && pos < n)
+            {
+                bitbuf |= (uint64_t)in[pos++] << bitcount;
+                bitcount += 8;
+            }
+        }
+
+        bool bits(int count, uint32_t &v)
+        {
+            if (bitcount < count)
+                refill();
+            if (bitcount < count)
+                return false;
+            v = (uint32_t)(bitbuf & ((1ull << count) - 1));
+            bitbuf >>= count;
+            bitcount -= count;
+            return true;
+        }
+
+        // Canonical codes from code lengths; false when over-subscribed
+        static bool build(Huffman &h, const uint8_t *lengths, int count)
+        {
+            std::memset(h.counts, 0, sizeof(h.counts));
+            std::memset(h.fast, 0, sizeof(h.fast));
+            for (int s = 0; s < count; ++s)
+                h.counts[lengths[s]]++;
+            h.counts[0] = 0;
+            uint16_t offs[16], next[16];
+            int left = 1, code = 0;
+            offs[1] = 0;
+            for (int len = 1; len < 16; ++len)
+            {
+                left = (left << 1) - h.counts[len];
+                if (left < 0)
+                    return false;
+                if (len < 15)
+                    offs[len + 1] = offs[len] + h.counts[len];
+                // first code of each length, as in RFC 1951 3.2.2
+                code = (code + h.counts[len - 1]) << 1;
+                next[len] = (uint16_t)code;
+            }
+            for (int s = 0; s < count; ++s)
+            {
+                int len = lengths[s];
+                if (!len)
+                    continue;
+                h.symbols[offs[len]++] = (uint16_t)s;
+                int c = next[len]++;
+                if (len > FAST_BITS)
+                    continue;
+                // the stream holds codes MSB first, the bit buffer LSB first
+                int r = 0;
+                for (int i = 0; i < len; ++i)
+                    r |= ((c >> i) & 1) << (len - 1 - i);
+                for (int i = r; i < (1 << FAST_BITS); i += 1 << len)
+                    h.fast[i] = (uint16_t)(len << 9 | s);
+            }
+            return true;
+        }
+
+        int decode(const Huffman &h)
+        {
+            if (bitcount < 15)
+                refill();
+            uint16_t e = h.fast[bitbuf & ((1 << FAST_BITS) - 1)];
+            int len = e >> 9;
+            if (e && len <= bitcount)
+            {
+                bitbuf >>= len;
+                bitcount -= len;
+                return e & 0x1FF;
+            }
+            // walk the canonical code one bit at a time
+            int code = 0, first = 0, index = 0;
+            for (len = 1; len < 16 && len <= bitcount; ++len)
+            {
+                code |= (int)((bitbuf >> (len - 1)) & 1);
+                int count = h.counts[len];
+                if (code - count < first)
+                {
+                    bitbuf >>= len;
+                    bitcount -= len;
+                    return h.symbols[index + (code - first)];
+                }
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+            return -1;
+        }
+
+        bool stored()
+        {
+            // back up to the byte boundary, then copy straight from the input
+            bitcount -= bitcount % 8;
+            pos -= bitcount / 8;
+            bitbuf = 0;
+            bitcount = 0;
+            if (n - pos < 4)
+                return false;
+            uint32_t len = in[pos] | in[pos + 1] << 8, nlen = in[pos + 2] | in[pos + 3] << 8;
+            pos += 4;
+            if ((len ^ 0xFFFF) != nlen || len > n - pos || len > outSize - outPos)
+                return false;
+            std::memcpy(out + outPos, in + pos, len);
+            pos += len;
+            outPos += len;
+            return true;
+        }
+
+        bool fixed()
+        {
+            uint8_t lengths[288 + 30];
+            std::memset(lengths, 8, 144);
+            std::memset(lengths + 144, 9, 112);
+            std::memset(lengths + 256, 7, 24);
+            std::memset(lengths + 280, 8, 8);
+            std::memset(lengths + 288, 5, 30);
+            return build(lit, lengths, 288) && build(dist, lengths + 288, 30) && codes();
+        }
+
+        bool dynamic()
+        {
+            static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+            uint32_t nlit, ndist, ncode;
+            if (!bits(5, nlit) || !bits(5, ndist) || !bits(4, ncode))
+                return false;
+            nlit += 257;
+            ndist += 1;
+            ncode += 4;
+            if (nlit > 286 || ndist > 30)
+                return false;
+
+            uint8_t lengths[286 + 30] = {0};
+            for (uint32_t i = 0; i < ncode; ++i)
+            {
+                uint32_t v;
+                if (!bits(3, v))
+                    return false;
+                lengths[order[i]] = (uint8_t)v;
+            }
+            Huffman lencode;
+            if (!build(lencode, lengths, 19))
+                return false;
+
+            std::memset(lengths, 0, 19);
+            for (uint32_t i = 0; i < nlit + ndist;)
+            {
+                int sym = decode(lencode);
+                if (sym < 0)
+                    return false;
+                if (sym < 16)
+                {
+                    lengths[i++] = (uint8_t)sym;
+                    continue;
+                }
+                uint32_t rep, value = 0;
+                if (sym == 16)
+                {
+                    if (i == 0 || !bits(2, rep))
+                        return false;
+                    value = lengths[i - 1];
+                    rep += 3;
+                }
+                else if (sym == 17)
+                {
+                    if (!bits(3, rep))
+                        return false;
+                    rep += 3;
+                }
+                else
+                {
+                    if (!bits(7, rep))
+                        return false;
+                    rep += 11;
+                }
+                if (i + rep > nlit + ndist)
+                    return false;
+                while (rep--)
+                    lengths[i++] = (uint8_t)value;
+            }
+            if (!lengths[256])
+                return false; // no end-of-block code
+            return build(lit, lengths, nlit) && build(dist, lengths + nlit, ndist) && codes();
+        }
+
+        bool codes()
+        {
+            static const uint16_t lbase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+            static const uint8_t lextra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+            static const uint16_t dbase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+            static const uint8_t dextra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+            for (;;)
+            {
+                int sym = decode(lit);
+                if (sym < 0)
+                    return false;
+                if (sym < 256)
+                {
+                    if (outPos == outSize)
+                        return false;
+                    out[outPos++] = (uint8_t)sym;
+                    continue;
+                }
+                if (sym == 256)
+                    return true;
+                sym -= 257;
+                if (sym >= 29)
+                    return false;
+                uint32_t len, extra;
+                if (!bits(lextra[sym], extra))
+                    return false;
+                len = lbase[sym] + extra;
+                int dsym = decode(dist);
+                if (dsym < 0 || dsym >= 30 || !bits(dextra[dsym], extra))
+                    return false;
+                size_t d = dbase[dsym] + extra;
+                if (d > outPos || len > outSize - outPos)
+                    return false;
+                // byte by byte: the source may overlap what is being written
+                uint8_t *o = out + outPos;
+                for (uint32_t k = 0; k < len; ++k)
+                    o[k] = o[k - d];
+                outPos += len;
+            }
+        }
+    };
+
+    // Reads a PNG of any standard colour type, bit depth and interlacing
+    // into packed RGBA. 16-bit samples keep their high byte.
+    class Reader
+    {
+    public:
+        static const uint32_t MAX_PIXELS = 1u << 26;
+
+        // Reads the file and checks its header; the pixels are decoded by read()
+        bool open(const std::string &path)
+        {
+            file.clear();
+            idat.clear();
+            palette.clear();
+            trns.clear();
+            width = height = 0;
+            std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+            if (!ifs)
+                return fail("cannot open " + path);
+            file.resize((size_t)ifs.tellg());
+            ifs.seekg(0);
+            if (!ifs.read((char *)file.data(), file.size()))
+                return fail("cannot read " + path);
+
+            static const uint8_t sig[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+            if (file.size() < 8 || std::memcmp(file.data(), sig, 8) != 0)
+                return fail("not a PNG file");
+            bool haveHeader = false, ended = false;
+            for (size_t p = 8; !ended;)
+            {
+                if (file.size() - p < 12)
+                    return fail("truncated chunk");
+                uint32_t len = get32(&file[p]);
+                if (len > file.size() - p - 12)
+                    return fail("truncated chunk");
+                const uint8_t *type = &file[p + 4], *body = &file[p + 8];
+                bool critical = !(type[0] & 0x20);
+                bool used = critical || std::memcmp(type, "tRNS", 4) == 0;
+                if (used && crc32(0, type, len + 4) != get32(body + len))
+                    return fail("bad chunk checksum");
+
+                if (std::memcmp(type, "IHDR", 4) == 0)
+                {
+                    if (len != 13 || !header(body))
+                        return false;
+                    haveHeader = true;
+                }
+                else if (!haveHeader)
+                    return fail("missing IHDR");
+                else if (std::memcmp(type, "PLTE", 4) == 0)
+                {
+                    if (len % 3 || len / 3 > 256)
+                        return fail("bad palette");
+                    for (uint32_t i = 0; i < len; i += 3)
+                        palette.push_back(body[i] | body[i + 1] << 8 | (uint32_t)body[i + 2] << 16 | 0xFF000000u);
+                }
+                else if (std::memcmp(type, "tRNS", 4) == 0)
+                    trns.assign(body, body + len);
+                else if (std::memcmp(type, "IDAT", 4) == 0)
+                    idat.insert(idat.end(), body, body + len);
+                else if (std::memcmp(type, "IEND", 4) == 0)
+                    ended = true;
+                else if (critical)
+                    return fail("unsupported chunk");
+                p += 12 + (size_t)len;
+            }
+            if (colorType == COLOR_PALETTE && palette.empty())
+                return fail("missing palette");
+            if (idat.empty())
+                return fail("no image data");
+            for (size_t i = 0; i < trns.size() && i < palette.size(); ++i)
+                palette[i] = (palette[i] & 0xFFFFFF) | (uint32_t)trns[i] << 24;
+            file.clear();
+            file.shrink_to_fit();
+            return true;
+        }
+
+        uint32_t getWidth() const { return width; }
+        uint32_t getHeight() const { return height; }
+        const std::string &error() const { return err; }
+
+        // Decodes into dst, row y at dst + y * stride (stride in pixels)
+        bool read(uint32_t *dst, size_t stride)
+        {
+            static const int X0[7] = {0, 4, 0, 2, 0, 1, 0}, Y0[7] = {0, 0, 4, 0, 2, 0, 1};
+            static const int DX[7] = {8, 8, 4, 4, 2, 2, 1}, DY[7] = {8, 8, 8, 4, 4, 2, 2};
+            int passes = interlaced ? 7 : 1;
+
+            // sub-images of the passes, one after another
+            size_t total = 0;
+            uint32_t pw[7], ph[7];
+            for (int p = 0; p < passes; ++p)
+            {
+                pw[p] = interlaced ? (width - X0[p] + DX[p] - 1) / DX[p] : width;
+                ph[p] = interlaced ? (height - Y0[p] + DY[p] - 1) / DY[p] : height;
+                if (width <= (uint32_t)X0[p] || height <= (uint32_t)Y0[p])
+                    pw[p] = ph[p] = 0;
+                if (pw[p])
+                    total += (size_t)ph[p] * (rowBytes(pw[p]) + 1);
+            }
+            std::vector<uint8_t> raw(total);
+            Inflater z;
+            if (!z.inflate(idat.data(), idat.size(), raw.data(), raw.size()))
+                return fail("corrupt image data");
+
+            uint8_t *p8 = raw.data();
+            for (int p = 0; p < passes; ++p)
+            {
+                if (!pw[p])
+                    continue;
+                size_t rb = rowBytes(pw[p]);
+                const uint8_t *prev = nullptr;
+                for (uint32_t y = 0; y < ph[p]; ++y, p8 += rb + 1)
+                {
+                    if (!unfilter(p8[0], p8 + 1, prev, rb))
+                        return fail("bad filter type");
+                    prev = p8 + 1;
+                    size_t row = interlaced ? (size_t)Y0[p] + (size_t)y * DY[p] : y;
+                    uint32_t *o = dst + row * stride + (interlaced ? X0[p] : 0);
+                    expand(p8 + 1, pw[p], o, interlaced ? DX[p] : 1);
+                }
+            }
+            return true;
+        }
+
+    private:
+        std::vector<uint8_t> file, idat, trns;
+        std::vector<uint32_t> palette; // packed RGBA, tRNS applied
+        uint32_t width = 0, height = 0;
+        int depth = 8, colorType = COLOR_RGBA, channels = 4;
+        bool interlaced = false;
+        std::string err;
+
+        static uint32_t get32(const uint8_t *p) { return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+
+        bool fail(const std::string &why)
+        {
+            err = why;
+            return false;
+        }
+
+        bool header(const uint8_t *h)
+        {
+            width = get32(h);
+            height = get32(h + 4);
+            depth = h[8];
+            colorType = h[9];
+            interlaced = h[12] == 1;
+            if (width == 0 || height == 0 || width > MAX_PIXELS || height > MAX_PIXELS || (uint64_t)width * height > MAX_PIXELS)
+                return fail("bad dimensions");
+            if (h[10] != 0 || h[11] != 0 || h[12] > 1)
+                return fail("unsupported compression, filter or interlace method");
+            bool ok = false;
+            switch (colorType)
+            {
+            case COLOR_GRAY: ok = depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16; channels = 1; break;
+            case COLOR_PALETTE: ok = depth == 1 || depth == 2 || depth == 4 || depth == 8; channels = 1; break;
+            case COLOR_RGB: ok = depth == 8 || depth == 16; channels = 3; break;
+            case COLOR_GRAY_ALPHA: ok = depth == 8 || depth == 16; channels = 2; break;
+            case COLOR_RGBA: ok = depth == 8 || depth == 16; channels = 4; break;
+            }
+            return ok || fail("bad colour type or bit depth");
+        }
+
+        size_t rowBytes(uint32_t w) const { return ((size_t)w * channels * depth + 7) / 8; }
+
+        bool unfilter(int filter, uint8_t *row, const uint8_t *prev, size_t n) const
+        {
+            size_t bpp = std::max(1, channels * depth / 8);
+            switch (filter)
+            {
+            case 0:
+                return true;
+            case 1:
+                for (size_t i = bpp; i < n; ++i)
+                    row[i] += row[i - bpp];
+                return true;
+            case 2:
+                if (prev)
+                    for (size_t i = 0; i < n; ++i)
+                        row[i] += prev[i];
+                return true;
+            case 3:
+                for (size_t i = 0; i < n; ++i)
+                    row[i] += (uint8_t)(((i >= bpp ? row[i - bpp] : 0) + (prev ? prev[i] : 0)) >> 1);
+                return true;
+            case 4:
+                for (size_t i = 0; i < n; ++i)
+                {
+                    int a = i >= bpp ? row[i - bpp] : 0;
+                    int b = prev ? prev[i] : 0;
+                    int c = i >= bpp && prev ? prev[i - bpp] : 0;
+                    int p = a + b - c;
+                    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                    row[i] += (uint8_t)(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+                }
+                return true;
+            }
+            return false;
+        }
+
+        // Sample i of a row; sub-byte samples are packed high bits first
+        uint32_t sample(const uint8_t *row, size_t i) const
+        {
+            if (depth == 8)
+                return row[i];
+            if (depth == 16)
+                return (uint32_t)row[2 * i] << 8 | row[2 * i + 1];
+            size_t bit = i * depth;
+            return (row[bit / 8] >> (8 - depth - bit % 8)) & ((1u << depth) - 1);
+        }
+
+        // 8-bit value of a sample
+        uint32_t level(uint32_t v) const
+        {
+            return depth == 16 ? v >> 8 : depth == 8 ? v : v * 255 / ((1u << depth) - 1);
+        }
+
+        // Whether a gray/RGB pixel matches the single tRNS colour
+        bool keyed(const uint32_t *s) const
+        {
+            if (trns.size() < (size_t)channels * 2)
+                return false;
+            for (int c = 0; c < channels; ++c)
+                if (s[c] != ((uint32_t)trns[2 * c] << 8 | trns[2 * c + 1]))
+                    return false;
+            return true;
+        }
+
+        void expand(const uint8_t *row, uint32_t w, uint32_t *out, int step) const
+        {
+            uint32_t s[4];
+            for (uint32_t x = 0; x < w; ++x, out += step)
+            {
+                for (int c = 0; c < channels; ++c)
+                    s[c] = sample(row, (size_t)x * channels + c);
+                switch (colorType)
+                {
+                case COLOR_PALETTE:
+                    *out = s[0] < palette.size() ? palette[s[0]] : 0;
+                    break;
+                case COLOR_GRAY:
+                {
+                    uint32_t g = level(s[0]);
+                    *out = g | g << 8 | g << 16 | (keyed(s) ? 0u : 0xFF000000u);
+                    break;
+                }
+                case COLOR_GRAY_ALPHA:
+                {
+                    uint32_t g = level(s[0]);
+                    *out = g | g << 8 | g << 16 | level(s[1]) << 24;
+                    break;
+                }
+                case COLOR_RGB:
+                    *out = level(s[0]) | level(s[1]) << 8 | level(s[2]) << 16 | (keyed(s) ? 0u : 0xFF000000u);
+                    break;
+                default:
+                    *out = level(s[0]) | level(s[1]) << 8 | level(s[2]) << 16 | level(s[3]) << 24;
+                }
+            }
+        }
+    };
+}
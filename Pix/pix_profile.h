@@ -0,0 +1,234 @@
+// pix_profile.h
+// Frame-time profiler behind the F3 HUD of both editors.
+//
+// The main loop calls frame() once per iteration, marks its sections with
+// phase() and wraps nested work in Scope timers. Time is exclusive: entering
+// a phase pauses the running one, so a frame's phase times add up to (at
+// most) its total.
+// Counters are bumped from wherever the work happens (pixel writes, texture
+// uploads, ...) and are reported per frame.
+// While pixtrace is recording, frames, sections and scopes are also emitted
+// as nested trace slices.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "pix_trace.h"
+
+namespace pixprof
+{
+    enum Phase
+    {
+        PHASE_EVENTS = 0,
+        PHASE_TOOLS,   // painting, fills
+        PHASE_UPLOAD,  // texture uploads, thumbnail rebuilds
+        PHASE_CANVAS,  // canvas, onion skin, grid
+        PHASE_UI,      // panels, timeline, status, HUD
+        PHASE_PRESENT, // buffer swap / vsync wait
+        PHASE_COUNT
+    };
+
+    enum Counter
+    {
+        COUNT_PIXELS = 0,
+        COUNT_UPLOADS,
+        COUNT_DRAWS,
+        COUNT_THUMBS,
+        COUNT_DROPPED, // animation frames playback skipped
+        COUNTER_COUNT
+    };
+
+    const int HISTORY = 120;
+
+    inline const char *phaseName(int p)
+    {
+        static const char *names[PHASE_COUNT] = {"events", "tools", "upload", "canvas", "ui", "present"};
+        return p >= 0 && p < PHASE_COUNT ? names[p] : "?";
+    }
+
+    inline const char *counterName(int c)
+    {
+        static const char *names[COUNTER_COUNT] = {"pixels", "uploads", "draws", "thumbs", "dropped"};
+        return c >= 0 && c < COUNTER_COUNT ? names[c] : "?";
+    }
+
+    // Bar colours for the stacked histogram, 0xRRGGBB
+    inline uint32_t phaseColor(int p)
+    {
+        static const uint32_t colors[PHASE_COUNT] = {0x29ADFF, 0xFF004D, 0xFFA300, 0x00E436, 0x83769C, 0x5F574F};
+        return p >= 0 && p < PHASE_COUNT ? colors[p] : 0xFFFFFF;
+    }
+
+    class Profiler
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        bool visible = false;
+
+        // Completed frames, oldest first at index head
+        float frameMs[HISTORY] = {};
+        float phaseMs[HISTORY][PHASE_COUNT] = {};
+        int head = 0;
+
+        // Last completed frame
+        uint64_t counters[COUNTER_COUNT] = {};
+
+        // Sums over every completed frame (for headless benchmark runs)
+        uint64_t totalFrames = 0;
+        double totalFrameMs = 0;
+        double totalPhaseMs[PHASE_COUNT] = {};
+        uint64_t totalCounters[COUNTER_COUNT] = {};
+
+        // Closes the current frame and starts the next one
+        void frame()
+        {
+            Clock::time_point now = Clock::now();
+            enter(active, now);
+            endSection(now);
+            if (started && pixtrace::enabled())
+                pixtrace::record("frame", frameStart, now);
+            if (started)
+            {
+                frameMs[head] = ms(now - frameStart);
+                for (int p = 0; p < PHASE_COUNT; ++p)
+                    phaseMs[head][p] = (float)accum[p];
+                head = (head + 1) % HISTORY;
+                std::copy(pending, pending + COUNTER_COUNT, counters);
+
+                ++totalFrames;
+                totalFrameMs += ms(now - frameStart);
+                for (int p = 0; p < PHASE_COUNT; ++p)
+                    totalPhaseMs[p] += accum[p];
+                for (int c = 0; c < COUNTER_COUNT; ++c)
+                    totalCounters[c] += pending[c];
+            }
+            std::fill(accum, accum + PHASE_COUNT, 0.0);
+            std::fill(pending, pending + COUNTER_COUNT, 0);
+            frameStart = now;
+            started = true;
+        }
+
+        void count(Counter c, uint64_t n = 1) { pending[c] += n; }
+
+        // Switches the running phase, returning the one that was running
+        int enter(int phase, Clock::time_point now = Clock::now())
+        {
+            if (active >= 0 && active < PHASE_COUNT)
+                accum[active] += ms(now - mark);
+            int prev = active;
+            active = phase;
+            mark = now;
+            return prev;
+        }
+
+        // Starts a straight-line section of the loop body
+        void section(int phase)
+        {
+            Clock::time_point now = Clock::now();
+            enter(phase, now);
+            endSection(now);
+            line = phase;
+            lineStart = now;
+        }
+
+        const float *last() const { return phaseMs[(head + HISTORY - 1) % HISTORY]; }
+        float lastFrameMs() const { return frameMs[(head + HISTORY - 1) % HISTORY]; }
+
+        float averageMs() const
+        {
+            float sum = 0;
+            for (float v : frameMs)
+                sum += v;
+            return sum / HISTORY;
+        }
+
+        float maxMs() const { return *std::max_element(frameMs, frameMs + HISTORY); }
+
+        // Text block for the HUD, one line per '\n'
+        std::string summary() const
+        {
+            char buf[128];
+            std::snprintf(buf, sizeof(buf), "FRAME %.2f ms  avg %.2f  max %.2f\n", lastFrameMs(), averageMs(), maxMs());
+            std::string s = buf;
+            const float *p = last();
+            for (int i = 0; i < PHASE_COUNT; ++i)
+            {
+                std::snprintf(buf, sizeof(buf), "%-8s %6.2f ms\n", phaseName(i), p[i]);
+                s += buf;
+            }
+            for (int i = 0; i < COUNTER_COUNT; ++i)
+            {
+                std::snprintf(buf, sizeof(buf), "%-8s %6llu\n", counterName(i), (unsigned long long)counters[i]);
+                s += buf;
+            }
+            return s;
+        }
+
+        // Text block of the running totals
+        std::string totals() const
+        {
+            char buf[128];
+            std::snprintf(buf, sizeof(buf), "frames   %llu  total %.2f ms  avg %.3f ms\n", (unsigned long long)totalFrames,
+                          totalFrameMs, totalFrames ? totalFrameMs / totalFrames : 0.0);
+            std::string s = buf;
+            for (int i = 0; i < PHASE_COUNT; ++i)
+            {
+                std::snprintf(buf, sizeof(buf), "%-8s %10.2f ms\n", phaseName(i), totalPhaseMs[i]);
+                s += buf;
+            }
+            for (int i = 0; i < COUNTER_COUNT; ++i)
+            {
+                std::snprintf(buf, sizeof(buf), "%-8s %10llu\n", counterName(i), (unsigned long long)totalCounters[i]);
+                s += buf;
+            }
+            return s;
+        }
+
+    private:
+        static double ms(Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); }
+
+        void endSection(Clock::time_point now)
+        {
+            if (line < PHASE_COUNT && pixtrace::enabled())
+                pixtrace::record(phaseName(line), lineStart, now);
+            line = PHASE_COUNT;
+        }
+
+        double accum[PHASE_COUNT] = {};
+        uint64_t pending[COUNTER_COUNT] = {};
+        int active = PHASE_COUNT; // none
+        int line = PHASE_COUNT;   // current section, for tracing
+        bool started = false;
+        Clock::time_point mark, frameStart, lineStart;
+    };
+
+    inline Profiler &profiler()
+    {
+        static Profiler p;
+        return p;
+    }
+
+    inline void count(Counter c, uint64_t n = 1) { profiler().count(c, n); }
+
+    // Marks the start of a phase in straight-line code (the main loop body)
+    inline void phase(Phase p) { profiler().section(p); }
+
+    // Attributes the enclosing block's time to a phase
+    class Scope
+    {
+    public:
+        explicit Scope(Phase p) : prev(profiler().enter(p)), zone(phaseName(p)) {}
+        ~Scope() { profiler().enter(prev); }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        int prev;
+        pixtrace::Zone zone;
+    };
+}
@@ -0,0 +1,429 @@
+// pix_project.h
+// Project file reader and writer shared by the SDL (v1) and SFML (v7)
+// editors, so each can open the other's projects.
+//
+// Formats, told apart by their magic:
+//   PXL1  i32 w, h, frames; raw RGBA frames                       (SDL, old)
+//   PXL2  i32 w, h, frames, key interval; per frame u8 kind,
+//         u32 size, delta-coded RGBA                              (SDL)
+//   PIX1  u32 w, h, frames; per frame u32 name length, name, raw RGBA
+//   PIXP  as PIX1 plus u32 palette size and RGBA palette after the
+//         header; frames hold one palette index per pixel
+//   PIXD  u32 w, h, frames, flags (1 = indexed, 2 = timed, 4 =
+//         layered), key interval, [palette as PIXP]; per frame name,
+//         [u32 duration in ms if timed], u32 kind, u32 size,
+//         delta-coded RGBA or indices, [u32 layer count and per layer
+//         name, u32 attributes, u32 kind, u32 size, delta-coded RGBA
+//         if layered]                                             (SFML)
+// Delta coding is pix_delta.h; a layer is coded against the same layer of
+// the frame's keyframe, or as a keyframe when that has fewer layers. The
+// frame record of a layered frame holds its composite, so readers that
+// ignore layers still get the picture. Pixels are packed RGBA with r in
+// the low byte, which is also the byte order of the RGBA files.
+//
+// The reader checks the dimensions and frame count against the file size
+// and a cap on the decoded total before anything is allocated, then
+// decodes one frame at a time straight into the caller's buffer.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "pix_delta.h"
+
+namespace pixproj
+{
+    enum Format
+    {
+        FORMAT_UNKNOWN = 0,
+        FORMAT_PXL1,
+        FORMAT_PXL2,
+        FORMAT_PIX1,
+        FORMAT_PIXP,
+        FORMAT_PIXD
+    };
+
+    const uint32_t MAX_SIDE = 16384;   // per dimension
+    const uint64_t MAX_PIXELS = 1u << 26;           // per frame
+    const uint64_t MAX_PROJECT_BYTES = 1ull << 31;  // all frames, decoded to RGBA
+    const uint32_t MAX_NAME = 4096;    // bytes per frame name
+    const uint32_t MAX_PALETTE = 256;
+    const uint32_t MAX_LAYERS = 256;   // per frame
+
+    struct Info
+    {
+        Format format = FORMAT_UNKNOWN;
+        uint32_t width = 0, height = 0, frames = 0;
+        bool indexed = false;          // frames hold palette indices
+        bool timed = false;            // frames carry a duration (PIXD)
+        bool layered = false;          // frames carry a layer stack (PIXD)
+        std::vector<uint32_t> palette; // packed RGBA
+
+        int bytesPerPixel() const { return indexed ? 1 : 4; }
+        size_t pixels() const { return (size_t)width * height; }
+        size_t frameBytes() const { return pixels() * bytesPerPixel(); }
+    };
+
+    // One layer of a frame: RGBA pixels (header().pixels() of them) and
+    // attributes the file stores without interpreting
+    struct Layer
+    {
+        std::string name;
+        uint32_t attrs = 0;
+        std::vector<uint8_t> px;
+    };
+
+    inline const char *magicOf(Format f)
+    {
+        static const char *m[] = {"", "PXL1", "PXL2", "PIX1", "PIXP", "PIXD"};
+        return m[f];
+    }
+
+    class Reader
+    {
+    public:
+        // Reads and validates the header; false (with error()) when the file
+        // is unreadable, of an unknown format or inconsistent with its size
+        bool open(const std::string &path)
+        {
+            ifs.close();
+            ifs.clear();
+            info = Info();
+            index = 0;
+            keyValid = false;
+            layerBytes = 0;
+            layerKeys.clear();
+            ifs.open(path, std::ios::binary | std::ios::ate);
+            if (!ifs)
+                return fail("cannot open " + path);
+            remaining = (uint64_t)ifs.tellg();
+            ifs.seekg(0);
+
+            char magic[4];
+            if (!take(magic, 4))
+                return fail("file too short");
+            for (int f = FORMAT_PXL1; f <= FORMAT_PIXD; ++f)
+                if (std::memcmp(magic, magicOf((Format)f), 4) == 0)
+                    info.format = (Format)f;
+            if (info.format == FORMAT_UNKNOWN)
+                return fail("unknown format");
+
+            uint32_t head[3];
+            if (!take(head, sizeof(head)))
+                return fail("truncated header");
+            info.width = head[0];
+            info.height = head[1];
+            info.frames = head[2];
+            if (info.format == FORMAT_PXL2 && !skip(4))
+                return fail("truncated header");
+            if (info.format == FORMAT_PIXD)
+            {
+                uint32_t flags;
+                if (!take(&flags, 4) || !skip(4))
+                    return fail("truncated header");
+                if (flags & ~7u)
+                    return fail("unsupported flags");
+                info.indexed = flags & 1;
+                info.timed = (flags & 2) != 0;
+                info.layered = (flags & 4) != 0;
+            }
+            if (info.format == FORMAT_PIXP)
+                info.indexed = true;
+            // PXL stores signed sizes; anything negative is huge here
+            if (info.width == 0 || info.height == 0 || info.width > MAX_SIDE || info.height > MAX_SIDE)
+                return fail("bad dimensions");
+            // Delta records expand a few bytes into a whole frame, so the file
+            // size alone does not bound what the editors allocate
+            if (info.pixels() > MAX_PIXELS || (uint64_t)info.frames * info.pixels() * 4 > MAX_PROJECT_BYTES)
+                return fail("project too large");
+
+            if (info.indexed)
+            {
+                uint32_t count;
+                if (!take(&count, 4) || count > MAX_PALETTE || (uint64_t)count * 4 > remaining)
+                    return fail("bad palette");
+                info.palette.resize(count);
+                if (!take(info.palette.data(), count * 4))
+                    return fail("truncated palette");
+            }
+
+            // Smallest possible record per frame bounds the frame count
+            uint64_t perFrame = (hasNames() ? 4 : 0) + (info.timed ? 4 : 0) + (info.layered ? 4 : 0);
+            if (isDelta())
+                perFrame += info.format == FORMAT_PXL2 ? 5 : 8;
+            else
+                perFrame += info.frameBytes();
+            if (info.frames == 0 || info.frames > remaining / perFrame)
+                return fail("frame count does not match the file size");
+            if (!isDelta() && !hasNames() && (uint64_t)info.frames * perFrame != remaining)
+                return fail("frame data does not match the file size");
+            if (isDelta())
+            {
+                code.reserve(std::min<uint64_t>(remaining, info.frameBytes() * 3 + 64));
+                key.resize(info.frameBytes());
+            }
+            return true;
+        }
+
+        const Info &header() const { return info; }
+        const std::string &error() const { return err; }
+        bool done() const { return index >= info.frames; }
+
+        // Decodes the next frame into dst (header().frameBytes() bytes: RGBA,
+        // or palette indices for indexed files). name gets the frame's name,
+        // or is left empty for PXL files.
+        bool next(uint8_t *dst, std::string &name)
+        {
+            if (done())
+                return fail("no more frames");
+            name.clear();
+            duration = 0;
+            frameLayers.clear();
+            if (hasNames())
+            {
+                uint32_t len;
+                if (!take(&len, 4) || len > MAX_NAME || len > remaining)
+                    return fail("bad frame name");
+                name.resize(len);
+                if (len && !take(&name[0], len))
+                    return fail("truncated frame name");
+            }
+            if (info.timed && !take(&duration, 4))
+                return fail("truncated frame duration");
+            if (!isDelta())
+            {
+                if (!take(dst, info.frameBytes()))
+                    return fail("truncated frame");
+                ++index;
+                return true;
+            }
+
+            uint32_t kind = 0, size = 0;
+            bool ok = info.format == FORMAT_PXL2 ? take(&kind, 1) : take(&kind, 4);
+            if (!ok || !take(&size, 4) || size > remaining)
+                return fail("truncated frame");
+            bool isKey = kind == pixdelta::KIND_KEY;
+            if (!isKey && !keyValid)
+                return fail("delta frame without a keyframe");
+            code.resize(size);
+            if (!take(code.data(), size) ||
+                !pixdelta::decode(code.data(), size, dst, isKey ? nullptr : key.data(), info.pixels(), info.bytesPerPixel()))
+                return fail("corrupt frame");
+            if (isKey)
+            {
+                std::memcpy(key.data(), dst, info.frameBytes());
+                keyValid = true;
+            }
+            lastKey = isKey;
+            if (info.layered && !readLayers())
+                return false;
+            ++index;
+            return true;
+        }
+
+        // Layers of the frame last returned, bottom first; empty for a
+        // frame stored flat
+        const std::vector<Layer> &layers() const { return frameLayers; }
+
+        // As next(), but always RGBA: indices are looked up in the palette
+        bool nextRGBA(uint32_t *dst, std::string &name)
+        {
+            if (!info.indexed)
+                return next((uint8_t *)dst, name);
+            // decode the indices into the tail of dst, then expand forwards
+            uint8_t *idx = (uint8_t *)dst + info.pixels() * 3;
+            if (!next(idx, name))
+                return false;
+            for (size_t i = 0; i < info.pixels(); ++i)
+                dst[i] = idx[i] < info.palette.size() ? info.palette[idx[i]] : 0;
+            return true;
+        }
+
+        // Whether the frame last returned was a keyframe (always true for
+        // raw formats); delta frames repeat most of their keyframe
+        bool wasKey() const { return lastKey || !isDelta(); }
+
+        // Display time in ms of the frame last returned; 0 when the file
+        // stores none
+        uint32_t frameDuration() const { return duration; }
+
+    private:
+        std::ifstream ifs;
+        uint64_t remaining = 0; // bytes left in the file
+        Info info;
+        uint32_t index = 0, duration = 0;
+        std::vector<uint8_t> code, key; // reused across frames
+        bool keyValid = false, lastKey = false;
+        std::vector<Layer> frameLayers;
+        std::vector<std::vector<uint8_t>> layerKeys; // layers of the last keyframe
+        uint64_t layerBytes = 0;                     // decoded by readLayers() so far
+        std::string err;
+
+        bool readLayers()
+        {
+            uint32_t count;
+            if (!take(&count, 4) || count > MAX_LAYERS || (uint64_t)count * 16 > remaining)
+                return fail("bad layer count");
+            // editors keep every layer of every frame, so they count against
+            // the same cap as the frames
+            layerBytes += (uint64_t)count * info.pixels() * 4;
+            if ((uint64_t)info.frames * info.pixels() * 4 + layerBytes > MAX_PROJECT_BYTES)
+                return fail("project too large");
+            if (lastKey)
+                layerKeys.clear();
+            frameLayers.resize(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                Layer &l = frameLayers[i];
+                uint32_t len, kind, size;
+                if (!take(&len, 4) || len > MAX_NAME || len > remaining)
+                    return fail("bad layer name");
+                l.name.resize(len);
+                if ((len && !take(&l.name[0], len)) || !take(&l.attrs, 4) || !take(&kind, 4) || !take(&size, 4) ||
+                    size > remaining)
+                    return fail("truncated layer");
+                bool isKey = kind == pixdelta::KIND_KEY;
+                if (!isKey && (lastKey || i >= layerKeys.size()))
+                    return fail("delta layer without a keyframe");
+                code.resize(size);
+                l.px.resize(info.pixels() * 4);
+                if (!take(code.data(), size) ||
+                    !pixdelta::decode(code.data(), size, l.px.data(), isKey ? nullptr : layerKeys[i].data(), info.pixels(), 4))
+                    return fail("corrupt layer");
+                if (lastKey)
+                    layerKeys.push_back(l.px);
+            }
+            return true;
+        }
+
+        bool isDelta() const { return info.format == FORMAT_PXL2 || info.format == FORMAT_PIXD; }
+        bool hasNames() const { return info.format != FORMAT_PXL1 && info.format != FORMAT_PXL2; }
+
+        bool take(void *p, uint64_t n)
+        {
+            if (n > remaining)
+                return false;
+            ifs.read((char *)p, n);
+            remaining -= n;
+            return (bool)ifs;
+        }
+
+        bool skip(uint64_t n)
+        {
+            if (n > remaining)
+                return false;
+            ifs.seekg(n, std::ios::cur);
+            remaining -= n;
+            return (bool)ifs;
+        }
+
+        bool fail(const std::string &why)
+        {
+            err = why;
+            return false;
+        }
+    };
+
+    // Writes the delta formats (PXL2, PIXD) one frame at a time
+    class Writer
+    {
+    public:
+        bool open(const std::string &path, const Info &header)
+        {
+            info = header;
+            index = 0;
+            layerKeys.clear();
+            ofs.close();
+            ofs.clear();
+            ofs.open(path, std::ios::binary | std::ios::trunc);
+            if (!ofs || (info.format != FORMAT_PXL2 && info.format != FORMAT_PIXD))
+                return false;
+            ofs.write(magicOf(info.format), 4);
+            put32(info.width);
+            put32(info.height);
+            put32(info.frames);
+            if (info.format == FORMAT_PIXD)
+                put32((info.indexed ? 1 : 0) | (info.timed ? 2 : 0) | (info.layered ? 4 : 0));
+            put32(pixdelta::KEY_INTERVAL);
+            if (info.format == FORMAT_PIXD && info.indexed)
+            {
+                put32((uint32_t)info.palette.size());
+                ofs.write((const char *)info.palette.data(), info.palette.size() * 4);
+            }
+            key.resize(info.frameBytes());
+            return (bool)ofs;
+        }
+
+        // px: header().frameBytes() bytes; name is ignored by PXL2,
+        // duration (ms) unless the header is timed and layers (each
+        // header().pixels() RGBA pixels) unless it is layered
+        bool add(const uint8_t *px, const std::string &name = std::string(), uint32_t duration = 0,
+                 const std::vector<Layer> &layers = std::vector<Layer>())
+        {
+            if (info.format == FORMAT_PIXD)
+            {
+                put32((uint32_t)name.size());
+                ofs.write(name.data(), name.size());
+                if (info.timed)
+                    put32(duration);
+            }
+            bool isKey = pixdelta::isKey(index);
+            code.clear();
+            pixdelta::encode(code, px, isKey ? nullptr : key.data(), info.pixels(), info.bytesPerPixel());
+            uint8_t kind = isKey ? pixdelta::KIND_KEY : pixdelta::KIND_DELTA;
+            if (info.format == FORMAT_PXL2)
+                ofs.write((const char *)&kind, 1);
+            else
+                put32(kind);
+            put32((uint32_t)code.size());
+            ofs.write((const char *)code.data(), code.size());
+            if (isKey)
+                std::memcpy(key.data(), px, info.frameBytes());
+            if (info.layered)
+            {
+                if (isKey)
+                    layerKeys.clear();
+                put32((uint32_t)layers.size());
+                for (size_t i = 0; i < layers.size(); ++i)
+                {
+                    const Layer &l = layers[i];
+                    put32((uint32_t)l.name.size());
+                    ofs.write(l.name.data(), l.name.size());
+                    put32(l.attrs);
+                    // same layer of the keyframe, when it has one
+                    bool layerKey = isKey || i >= layerKeys.size();
+                    code.clear();
+                    pixdelta::encode(code, l.px.data(), layerKey ? nullptr : layerKeys[i].data(), info.pixels(), 4);
+                    put32(layerKey ? pixdelta::KIND_KEY : pixdelta::KIND_DELTA);
+                    put32((uint32_t)code.size());
+                    ofs.write((const char *)code.data(), code.size());
+                    if (isKey)
+                        layerKeys.push_back(l.px);
+                }
+            }
+            ++index;
+            return (bool)ofs;
+        }
+
+        bool close()
+        {
+            if (!ofs.is_open())
+                return false;
+            ofs.close();
+            return index == info.frames && (bool)ofs;
+        }
+
+    private:
+        std::ofstream ofs;
+        Info info;
+        uint32_t index = 0;
+        std::vector<uint8_t> code, key; // reused across frames
+        std::vector<std::vector<uint8_t>> layerKeys; // layers of the last keyframe
+
+        void put32(uint32_t v) { ofs.write((const char *)&v, 4); }
+    };
+}
@@ -0,0 +1,173 @@
+// pix_tiles.h
+// Copy-on-write tiled pixel planes, the storage behind frame snapshots.
+//
+// A plane is a table of TILE x TILE tiles held by shared pointers. Copying a
+// plane copies one pointer; the table and then the touched tile are cloned
+// only when a shared plane is written to. A snapshot therefore costs
+// O(frames), and memory is duplicated only for tiles edited afterwards.
+//
+// A plane is written by one thread at a time, and never while another
+// thread copies it; copies may be read and dropped on any thread. That is
+// what makes the use_count() checks safe: a table or tile only the written
+// plane holds could gain a reference only by copying that plane, so a
+// count of 1 stays 1 while the writer relies on it.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace pixtile
+{
+    const unsigned TILE = 32; // pixels per tile side
+
+    template <class T>
+    class Plane
+    {
+    public:
+        Plane() {}
+        Plane(unsigned w, unsigned h, T value = T()) { create(w, h, value); }
+
+        // Every tile starts out as the same shared blank tile
+        void create(unsigned w, unsigned h, T value = T())
+        {
+            width = w;
+            height = h;
+            cols = (w + TILE - 1) / TILE;
+            rows = (h + TILE - 1) / TILE;
+            auto blank = std::make_shared<Tile>();
+            std::fill(blank->px, blank->px + TILE * TILE, value);
+            table = std::make_shared<Table>((size_t)cols * rows, blank);
+        }
+
+        void release()
+        {
+            table.reset();
+            width = height = cols = rows = 0;
+        }
+
+        bool empty() const { return !table; }
+        unsigned getWidth() const { return width; }
+        unsigned getHeight() const { return height; }
+
+        T get(unsigned x, unsigned y) const
+        {
+            return (*table)[(size_t)(y / TILE) * cols + x / TILE]->px[(y % TILE) * TILE + x % TILE];
+        }
+
+        void set(unsigned x, unsigned y, T value)
+        {
+            writable(x / TILE, y / TILE).px[(y % TILE) * TILE + x % TILE] = value;
+        }
+
+        // Row-major copy of the whole plane into dst (width * height values)
+        void read(T *dst) const
+        {
+            for (unsigned ty = 0; ty < rows; ++ty)
+                for (unsigned tx = 0; tx < cols; ++tx)
+                {
+                    const Tile &t = *(*table)[(size_t)ty * cols + tx];
+                    unsigned x0 = tx * TILE, y0 = ty * TILE;
+                    unsigned w = std::min(TILE, width - x0), h = std::min(TILE, height - y0);
+                    for (unsigned y = 0; y < h; ++y)
+                        std::memcpy(dst + (size_t)(y0 + y) * width + x0, t.px + y * TILE, w * sizeof(T));
+                }
+        }
+
+        std::vector<T> read() const
+        {
+            std::vector<T> out((size_t)width * height);
+            if (table)
+                read(out.data());
+            return out;
+        }
+
+        // Replaces the pixels from a row-major buffer of width * height values
+        void write(const T *src)
+        {
+            for (unsigned ty = 0; ty < rows; ++ty)
+                for (unsigned tx = 0; tx < cols; ++tx)
+                {
+                    Tile &t = writable(tx, ty);
+                    unsigned x0 = tx * TILE, y0 = ty * TILE;
+                    unsigned w = std::min(TILE, width - x0), h = std::min(TILE, height - y0);
+                    for (unsigned y = 0; y < h; ++y)
+                        std::memcpy(t.px + y * TILE, src + (size_t)(y0 + y) * width + x0, w * sizeof(T));
+                }
+        }
+
+        unsigned tileCols() const { return cols; }
+        unsigned tileRows() const { return rows; }
+
+        // A tile's TILE * TILE pixels (row stride TILE). Two planes return
+        // the same pointer exactly when they share the tile, which is how
+        // the autosave journal finds the tiles edited since its last flush.
+        const T *tile(unsigned tx, unsigned ty) const { return (*table)[(size_t)ty * cols + tx]->px; }
+
+        void setTile(unsigned tx, unsigned ty, const T *px)
+        {
+            std::memcpy(writable(tx, ty).px, px, TILE * TILE * sizeof(T));
+        }
+
+        // Makes tile (tx, ty) the one src holds there, shared rather than
+        // copied; src must have the same size
+        void shareTile(unsigned tx, unsigned ty, const Plane &src)
+        {
+            if (!exclusive(table))
+                table = std::make_shared<Table>(*table);
+            (*table)[(size_t)ty * cols + tx] = (*src.table)[(size_t)ty * src.cols + tx];
+        }
+
+        // Points every tile whose pixels equal ref's tile at the same place
+        // at that tile, so a frame repeating most of its keyframe stores the
+        // repeats once. Both planes must have the same size.
+        void shareEqualTiles(const Plane &ref)
+        {
+            if (!table || !ref.table || ref.width != width || ref.height != height)
+                return;
+            if (!exclusive(table))
+                table = std::make_shared<Table>(*table);
+            for (size_t i = 0; i < table->size(); ++i)
+            {
+                std::shared_ptr<Tile> &t = (*table)[i];
+                const std::shared_ptr<Tile> &r = (*ref.table)[i];
+                if (t != r && std::memcmp(t->px, r->px, sizeof(t->px)) == 0)
+                    t = r;
+            }
+        }
+
+    private:
+        struct Tile
+        {
+            T px[TILE * TILE];
+        };
+        typedef std::vector<std::shared_ptr<Tile>> Table;
+
+        std::shared_ptr<Table> table;
+        unsigned width = 0, height = 0, cols = 0, rows = 0;
+
+        // True when nobody else holds p. The fence pairs with the release
+        // decrement of a reader on another thread dropping its copy.
+        template <class P>
+        static bool exclusive(const std::shared_ptr<P> &p)
+        {
+            if (p.use_count() != 1)
+                return false;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return true;
+        }
+
+        Tile &writable(unsigned tx, unsigned ty)
+        {
+            if (!exclusive(table))
+                table = std::make_shared<Table>(*table);
+            std::shared_ptr<Tile> &t = (*table)[(size_t)ty * cols + tx];
+            if (!exclusive(t))
+                t = std::make_shared<Tile>(*t);
+            return *t;
+        }
+    };
+}
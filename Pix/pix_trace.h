@@ -0,0 +1,185 @@
+// pix_trace.h
+// Session tracing in Chrome trace-event JSON (chrome://tracing, Perfetto).
+//
+// PIX_TRACE_SCOPE("name") records a complete ("X") event covering the
+// enclosing block. While tracing is off a zone costs one relaxed atomic load.
+// While it is on, each thread appends to its own ring buffer (the newest
+// RING_SIZE events survive), so long sessions cannot grow without bound.
+// Zone names must be string literals: only the pointer is stored.
+//
+// Define PIX_NO_TRACE to compile every zone out.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pixtrace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const size_t RING_SIZE = 1 << 16; // events kept per thread
+
+    struct Event
+    {
+        const char *name;
+        Clock::time_point start;
+        Clock::duration dur;
+    };
+
+    struct Buffer
+    {
+        std::mutex lock; // only contended while a dump reads the buffer
+        std::vector<Event> events;
+        size_t next = 0; // oldest event once the ring has wrapped
+        uint32_t tid = 0;
+        std::string name;
+    };
+
+    struct State
+    {
+        std::atomic<bool> on{false};
+        std::mutex lock;
+        std::vector<std::shared_ptr<Buffer>> buffers;
+        Clock::time_point epoch = Clock::now();
+        uint32_t nextTid = 1;
+    };
+
+    inline State &state()
+    {
+        static State s;
+        return s;
+    }
+
+    inline bool enabled() { return state().on.load(std::memory_order_relaxed); }
+
+    // This thread's buffer, registered on first use. The registry keeps it
+    // alive after the thread exits so short-lived workers still show up.
+    inline Buffer &local()
+    {
+        thread_local std::shared_ptr<Buffer> buf;
+        if (!buf)
+        {
+            buf = std::make_shared<Buffer>();
+            State &st = state();
+            std::lock_guard<std::mutex> g(st.lock);
+            buf->tid = st.nextTid++;
+            buf->name = buf->tid == 1 ? "main" : "worker " + std::to_string(buf->tid - 1);
+            st.buffers.push_back(buf);
+        }
+        return *buf;
+    }
+
+    inline void setThreadName(const std::string &name)
+    {
+        Buffer &b = local();
+        std::lock_guard<std::mutex> g(b.lock);
+        b.name = name;
+    }
+
+    inline void record(const char *name, Clock::time_point start, Clock::time_point end)
+    {
+        Buffer &b = local();
+        std::lock_guard<std::mutex> g(b.lock);
+        Event e = {name, start, end - start};
+        if (b.events.size() < RING_SIZE)
+            b.events.push_back(e);
+        else
+        {
+            b.events[b.next] = e;
+            b.next = (b.next + 1) % RING_SIZE;
+        }
+    }
+
+    // Starts a fresh capture, dropping earlier events and finished threads
+    inline void start()
+    {
+        State &st = state();
+        {
+            std::lock_guard<std::mutex> g(st.lock);
+            std::vector<std::shared_ptr<Buffer>> alive;
+            for (auto &b : st.buffers)
+            {
+                if (b.use_count() == 1)
+                    continue;
+                std::lock_guard<std::mutex> bg(b->lock);
+                b->events.clear();
+                b->next = 0;
+                alive.push_back(b);
+            }
+            st.buffers.swap(alive);
+            st.epoch = Clock::now();
+        }
+        st.on = true;
+    }
+
+    inline void stop() { state().on = false; }
+
+    // Writes everything captured so far; tracing may still be running
+    inline bool dump(const std::string &path)
+    {
+        std::ofstream ofs(path);
+        if (!ofs)
+            return false;
+        State &st = state();
+        std::lock_guard<std::mutex> g(st.lock);
+        auto us = [&](Clock::duration d)
+        { return std::chrono::duration<double, std::micro>(d).count(); };
+
+        ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        for (auto &b : st.buffers)
+        {
+            std::lock_guard<std::mutex> bg(b->lock);
+            ofs << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b->tid
+                << ",\"args\":{\"name\":\"" << b->name << "\"}}";
+            first = false;
+            for (size_t i = 0; i < b->events.size(); ++i)
+            {
+                const Event &e = b->events[(b->next + i) % b->events.size()];
+                if (e.start < st.epoch)
+                    continue;
+                ofs << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << b->tid
+                    << ",\"ts\":" << us(e.start - st.epoch) << ",\"dur\":" << us(e.dur) << "}";
+            }
+        }
+        ofs << "\n]}\n";
+        return (bool)ofs;
+    }
+
+    class Zone
+    {
+    public:
+        explicit Zone(const char *n) : name(n), on(enabled())
+        {
+            if (on)
+                t0 = Clock::now();
+        }
+        ~Zone()
+        {
+            if (on)
+                record(name, t0, Clock::now());
+        }
+        Zone(const Zone &) = delete;
+        Zone &operator=(const Zone &) = delete;
+
+    private:
+        const char *name;
+        bool on;
+        Clock::time_point t0;
+    };
+}
+
+#ifdef PIX_NO_TRACE
+#define PIX_TRACE_SCOPE(name)
+#else
+#define PIX_TRACE_CAT2(a, b) a##b
+#define PIX_TRACE_CAT(a, b) PIX_TRACE_CAT2(a, b)
+#define PIX_TRACE_SCOPE(name) pixtrace::Zone PIX_TRACE_CAT(pixTraceZone, __LINE__)(name)
+#endif
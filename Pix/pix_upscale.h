@@ -0,0 +1,300 @@
+// pix_upscale.h
+// Integer-scale pixel-art upscalers used by the PNG exporters.
+//
+// Pixels are packed 32-bit RGBA with r in the low byte (v1's rgba_u layout,
+// which is also the byte order of sf::Image on little-endian machines).
+//
+// Every kernel works on one source row plus its two vertical neighbours and
+// emits `scale` finished output rows, so exporters can stream the result to
+// disk without ever holding the whole upscaled image.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace pixup
+{
+    enum Mode
+    {
+        MODE_NEAREST = 0,
+        MODE_EPX,  // Scale2x / Scale3x (AdvMAME), topped up with nearest for other factors
+        MODE_EDGE, // xBR-style diagonal edge smoothing, any factor
+        MODE_COUNT
+    };
+
+    const int MAX_SCALE = 8;
+
+    inline const char *modeName(Mode m)
+    {
+        switch (m)
+        {
+        case MODE_NEAREST:
+            return "NEAREST";
+        case MODE_EPX:
+            return "EPX";
+        case MODE_EDGE:
+            return "EDGE";
+        default:
+            return "?";
+        }
+    }
+
+    // Whether the output only uses colours of the source (so a palette of
+    // the source also covers the upscaled image)
+    inline bool preservesColors(Mode m) { return m != MODE_EDGE; }
+
+    inline int chan(uint32_t c, int i) { return (c >> (8 * i)) & 0xFF; }
+
+    // Colour distance weighted towards luma, like the xBR family uses
+    inline int dist(uint32_t a, uint32_t b)
+    {
+        if (a == b)
+            return 0;
+        int dr = chan(a, 0) - chan(b, 0);
+        int dg = chan(a, 1) - chan(b, 1);
+        int db = chan(a, 2) - chan(b, 2);
+        int da = chan(a, 3) - chan(b, 3);
+        return 2 * std::abs(dr) + 4 * std::abs(dg) + std::abs(db) + 3 * std::abs(da);
+    }
+
+    // Straight-alpha blend of b over a with weight t/256, weighting colour by
+    // alpha so transparent neighbours don't bleed black into edges.
+    inline uint32_t blend(uint32_t a, uint32_t b, int t)
+    {
+        if (t <= 0 || a == b)
+            return a;
+        if (t >= 256)
+            return b;
+        int aa = chan(a, 3) * (256 - t), ba = chan(b, 3) * t;
+        int sum = aa + ba;
+        uint32_t out = (uint32_t)(sum >> 8) << 24;
+        if (sum == 0)
+            return out;
+        for (int i = 0; i < 3; ++i)
+            out |= (uint32_t)((chan(a, i) * aa + chan(b, i) * ba) / sum) << (8 * i);
+        return out;
+    }
+
+    // Scratch rows reused between calls (one set per thread)
+    struct Scratch
+    {
+        std::vector<uint32_t> base[3];
+    };
+
+    inline void nearestRow(int scale, const uint32_t *cur, int w, uint32_t *const *out)
+    {
+        uint32_t *o = out[0];
+        for (int x = 0; x < w; ++x)
+        {
+            uint32_t c = cur[x];
+            for (int k = 0; k < scale; ++k)
+                o[x * scale + k] = c;
+        }
+        for (int r = 1; r < scale; ++r)
+            std::memcpy(out[r], o, sizeof(uint32_t) * (size_t)w * scale);
+    }
+
+    // Scale2x: straight-line loop over ternaries so the compiler can vectorize it
+    inline void scale2xRow(const uint32_t *up, const uint32_t *cur, const uint32_t *down, int w,
+                           uint32_t *o0, uint32_t *o1)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            uint32_t B = up[x], H = down[x], E = cur[x];
+            uint32_t D = cur[x > 0 ? x - 1 : 0];
+            uint32_t F = cur[x < w - 1 ? x + 1 : x];
+            bool ok = B != H && D != F;
+            o0[2 * x] = (ok && D == B) ? D : E;
+            o0[2 * x + 1] = (ok && B == F) ? F : E;
+            o1[2 * x] = (ok && D == H) ? D : E;
+            o1[2 * x + 1] = (ok && H == F) ? F : E;
+        }
+    }
+
+    inline void scale3xRow(const uint32_t *up, const uint32_t *cur, const uint32_t *down, int w,
+                           uint32_t *o0, uint32_t *o1, uint32_t *o2)
+    {
+        for (int x = 0; x < w; ++x)
+        {
+            int xl = x > 0 ? x - 1 : 0, xr = x < w - 1 ? x + 1 : x;
+            uint32_t A = up[xl], B = up[x], C = up[xr];
+            uint32_t D = cur[xl], E = cur[x], F = cur[xr];
+            uint32_t G = down[xl], H = down[x], I = down[xr];
+            bool ok = B != H && D != F;
+            o0[3 * x] = (ok && D == B) ? D : E;
+            o0[3 * x + 1] = (ok && ((D == B && E != C) || (B == F && E != A))) ? B : E;
+            o0[3 * x + 2] = (ok && B == F) ? F : E;
+            o1[3 * x] = (ok && ((D == B && E != G) || (D == H && E != A))) ? D : E;
+            o1[3 * x + 1] = E;
+            o1[3 * x + 2] = (ok && ((B == F && E != I) || (H == F && E != C))) ? F : E;
+            o2[3 * x] = (ok && D == H) ? D : E;
+            o2[3 * x + 1] = (ok && ((D == H && E != I) || (H == F && E != G))) ? H : E;
+            o2[3 * x + 2] = (ok && H == F) ? F : E;
+        }
+    }
+
+    // Coverage of the bottom-right corner triangle for each sub-pixel of an
+    // NxN block, 0..256. The edge runs at 45 degrees through (0.75, 0.75) of
+    // the source pixel, as in xBR level 1; the other corners are mirrors.
+    inline const uint16_t *edgeWeights(int scale)
+    {
+        struct Tables
+        {
+            uint16_t w[MAX_SCALE + 1][MAX_SCALE * MAX_SCALE];
+            Tables()
+            {
+                for (int n = 1; n <= MAX_SCALE; ++n)
+                    for (int sy = 0; sy < n; ++sy)
+                        for (int sx = 0; sx < n; ++sx)
+                        {
+                            float u = (sx + 0.5f) / n, v = (sy + 0.5f) / n;
+                            float t = (u + v - 1.5f) * n + 0.5f;
+                            t = std::min(1.0f, std::max(0.0f, t));
+                            w[n][sy * n + sx] = (uint16_t)(t * 256.0f + 0.5f);
+                        }
+            }
+        };
+        static const Tables tables;
+        return tables.w[scale];
+    }
+
+    // One corner of the edge-aware filter: if the two orthogonal neighbours
+    // p and q form a diagonal edge that cuts across E's corner (checked with
+    // xBR's weighted-distance test), returns the colour to blend in.
+    inline bool edgeCorner(uint32_t E, uint32_t p, uint32_t q, uint32_t diag,
+                           uint32_t across1, uint32_t across2, uint32_t outer1, uint32_t outer2, uint32_t &col)
+    {
+        if (E == p || E == q)
+            return false;
+        int along = dist(E, across1) + dist(E, across2) + 4 * dist(p, q);
+        int cross = dist(p, outer1) + dist(q, outer2) + 4 * dist(E, diag);
+        if (along >= cross)
+            return false;
+        col = dist(E, p) <= dist(E, q) ? p : q;
+        return true;
+    }
+
+    inline void edgeRow(int scale, const uint32_t *up, const uint32_t *cur, const uint32_t *down, int w,
+                        uint32_t *const *out)
+    {
+        const uint16_t *wt = edgeWeights(scale);
+        int n = scale;
+        for (int x = 0; x < w; ++x)
+        {
+            int xl = x > 0 ? x - 1 : 0, xr = x < w - 1 ? x + 1 : x;
+            uint32_t A = up[xl], B = up[x], C = up[xr];
+            uint32_t D = cur[xl], E = cur[x], F = cur[xr];
+            uint32_t G = down[xl], H = down[x], I = down[xr];
+
+            uint32_t cBR = E, cBL = E, cTR = E, cTL = E;
+            bool br = edgeCorner(E, F, H, I, C, G, B, D, cBR);
+            bool bl = edgeCorner(E, D, H, G, A, I, B, F, cBL);
+            bool tr = edgeCorner(E, F, B, C, A, I, H, D, cTR);
+            bool tl = edgeCorner(E, D, B, A, C, G, H, F, cTL);
+
+            for (int sy = 0; sy < n; ++sy)
+            {
+                uint32_t *o = out[sy] + (size_t)x * n;
+                for (int sx = 0; sx < n; ++sx)
+                {
+                    uint32_t c = E;
+                    if (br)
+                        c = blend(c, cBR, wt[sy * n + sx]);
+                    if (bl)
+                        c = blend(c, cBL, wt[sy * n + (n - 1 - sx)]);
+                    if (tr)
+                        c = blend(c, cTR, wt[(n - 1 - sy) * n + sx]);
+                    if (tl)
+                        c = blend(c, cTL, wt[(n - 1 - sy) * n + (n - 1 - sx)]);
+                    o[sx] = c;
+                }
+            }
+        }
+    }
+
+    // Emits `scale` output rows of w*scale pixels for source row `cur`.
+    // Pass up == cur / down == cur at the top and bottom image edges.
+    inline void upscaleRow(Mode mode, int scale, const uint32_t *up, const uint32_t *cur, const uint32_t *down,
+                           int w, uint32_t *const *out, Scratch &s)
+    {
+        if (scale <= 1)
+        {
+            std::memcpy(out[0], cur, sizeof(uint32_t) * (size_t)w);
+            return;
+        }
+
+        if (mode == MODE_EDGE)
+        {
+            edgeRow(scale, up, cur, down, w, out);
+            return;
+        }
+        if (mode != MODE_EPX)
+        {
+            nearestRow(scale, cur, w, out);
+            return;
+        }
+
+        // EPX: run Scale3x for multiples of 3, Scale2x otherwise, then
+        // replicate the base sub-pixels up to the requested factor.
+        int b = (scale % 3 == 0) ? 3 : 2;
+        if (scale == 2)
+        {
+            scale2xRow(up, cur, down, w, out[0], out[1]);
+            return;
+        }
+        if (scale == 3)
+        {
+            scale3xRow(up, cur, down, w, out[0], out[1], out[2]);
+            return;
+        }
+
+        for (int r = 0; r < b; ++r)
+            s.base[r].resize((size_t)w * b);
+        if (b == 2)
+            scale2xRow(up, cur, down, w, s.base[0].data(), s.base[1].data());
+        else
+            scale3xRow(up, cur, down, w, s.base[0].data(), s.base[1].data(), s.base[2].data());
+
+        int sub[MAX_SCALE];
+        for (int k = 0; k < scale; ++k)
+            sub[k] = k * b / scale;
+        for (int r = 0; r < scale; ++r)
+        {
+            const uint32_t *src = s.base[sub[r]].data();
+            uint32_t *o = out[r];
+            for (int x = 0; x < w; ++x)
+                for (int k = 0; k < scale; ++k)
+                    o[x * scale + k] = src[x * b + sub[k]];
+        }
+    }
+
+    // Streams an upscaled copy of a w x h image (rows `stride` pixels apart)
+    // to sink(const uint32_t *row), one output row at a time. Only `scale`
+    // output rows are alive at once. Stops early if the sink returns false.
+    template <class Sink>
+    bool upscaleImage(Mode mode, int scale, const uint32_t *src, int w, int h, size_t stride, Sink &&sink)
+    {
+        scale = std::max(1, std::min(MAX_SCALE, scale));
+        std::vector<uint32_t> rows((size_t)w * scale * scale);
+        uint32_t *out[MAX_SCALE];
+        for (int r = 0; r < scale; ++r)
+            out[r] = rows.data() + (size_t)r * w * scale;
+        Scratch scratch;
+
+        for (int y = 0; y < h; ++y)
+        {
+            const uint32_t *cur = src + (size_t)y * stride;
+            const uint32_t *up = y > 0 ? cur - stride : cur;
+            const uint32_t *down = y < h - 1 ? cur + stride : cur;
+            upscaleRow(mode, scale, up, cur, down, w, out, scratch);
+            for (int r = 0; r < scale; ++r)
+                if (!sink((const uint32_t *)out[r]))
+                    return false;
+        }
+        return true;
+    }
+}
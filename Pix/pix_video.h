@@ -0,0 +1,193 @@
+// pix_video.h
+// Uncompressed video output for encoding pipelines: YUV4MPEG2 (.y4m, read
+// by ffmpeg, x264 and most encoders) or headerless RGBA frames.
+//
+// One frame is buffered at a time and written whole, so memory stays
+// constant however long the video is, and a frame held on screen for
+// several video frames is converted once and written repeatedly. Writing
+// to the path "-" sends the stream to stdout for piping, e.g.
+//   pix --video - | ffmpeg -i - trailer.mp4
+//
+// Y4M uses BT.601 limited-range YCbCr, 4:2:0 (chroma centred, ffmpeg's
+// yuv420p) or 4:4:4, which keeps single-pixel colour detail. Video has no
+// alpha, so pixels are composited over a background colour first; raw
+// RGBA keeps the alpha channel.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace pixvideo
+{
+    enum Format
+    {
+        FORMAT_Y4M_420 = 0,
+        FORMAT_Y4M_444,
+        FORMAT_RGBA,
+        FORMAT_COUNT
+    };
+
+    inline const char *formatName(Format f)
+    {
+        static const char *names[] = {"y4m", "y4m444", "rgba"};
+        return f < FORMAT_COUNT ? names[f] : "?";
+    }
+
+    inline bool parseFormat(const std::string &name, Format &f)
+    {
+        for (int i = 0; i < FORMAT_COUNT; ++i)
+            if (name == formatName((Format)i))
+            {
+                f = (Format)i;
+                return true;
+            }
+        return false;
+    }
+
+    class Writer
+    {
+    public:
+        ~Writer() { close(); }
+
+        // background: packed RGBA (r in the low byte) shown through
+        // transparent pixels in Y4M output
+        bool open(const std::string &path, uint32_t w, uint32_t h, uint32_t fps, Format f, uint32_t background = 0xFF000000u)
+        {
+            close();
+            if (path == "-")
+            {
+#ifdef _WIN32
+                _setmode(_fileno(stdout), _O_BINARY);
+#endif
+                file = stdout;
+            }
+            else
+                file = std::fopen(path.c_str(), "wb");
+            if (!file || !w || !h || !fps)
+                return false;
+            width = w;
+            height = h;
+            format = f;
+            bg = background;
+            ok = true;
+            if (format == FORMAT_RGBA)
+            {
+                frame.assign((size_t)w * h * 4, 0);
+                return true;
+            }
+            // full-resolution planes; 4:2:0 chroma is averaged when written
+            frame.assign((size_t)w * h * 3, 0);
+            if (format == FORMAT_Y4M_420)
+                chroma.assign((size_t)((w + 1) / 2) * ((h + 1) / 2) * 2, 0);
+            char header[128];
+            std::snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 %s XCOLORRANGE=LIMITED\n",
+                          w, h, fps, format == FORMAT_Y4M_420 ? "C420jpeg" : "C444");
+            return put(header, std::strlen(header));
+        }
+
+        // Row y of the next frame: width packed RGBA pixels
+        void setRow(uint32_t y, const uint32_t *px)
+        {
+            if (format == FORMAT_RGBA)
+            {
+                std::memcpy(&frame[(size_t)y * width * 4], px, (size_t)width * 4);
+                return;
+            }
+            size_t plane = (size_t)width * height;
+            uint8_t *Y = &frame[(size_t)y * width], *U = Y + plane, *V = U + plane;
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                int r, g, b;
+                over(px[x], r, g, b);
+                Y[x] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                U[x] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+                V[x] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+            }
+        }
+
+        // Writes the frame set by setRow(); calling it again repeats the frame
+        bool writeFrame()
+        {
+            if (!file || !ok)
+                return false;
+            if (format == FORMAT_RGBA)
+                return put(frame.data(), frame.size());
+            if (!put("FRAME\n", 6))
+                return false;
+            size_t plane = (size_t)width * height;
+            if (format == FORMAT_Y4M_444)
+                return put(frame.data(), plane * 3);
+            subsample();
+            return put(frame.data(), plane) && put(chroma.data(), chroma.size());
+        }
+
+        bool close()
+        {
+            if (!file)
+                return false;
+            bool good = ok && std::fflush(file) == 0;
+            if (file != stdout)
+                good = std::fclose(file) == 0 && good;
+            file = nullptr;
+            return good;
+        }
+
+    private:
+        std::FILE *file = nullptr;
+        uint32_t width = 0, height = 0;
+        Format format = FORMAT_Y4M_420;
+        uint32_t bg = 0xFF000000u;
+        bool ok = false;
+        std::vector<uint8_t> frame, chroma;
+
+        bool put(const void *p, size_t n)
+        {
+            ok = ok && std::fwrite(p, 1, n, file) == n;
+            return ok;
+        }
+
+        // Straight-alpha composite over the background
+        void over(uint32_t c, int &r, int &g, int &b) const
+        {
+            int a = c >> 24;
+            auto mix = [&](int shift)
+            {
+                int s = (c >> shift) & 0xFF, d = (bg >> shift) & 0xFF;
+                return (s * a + d * (255 - a) + 127) / 255;
+            };
+            r = mix(0);
+            g = mix(8);
+            b = mix(16);
+        }
+
+        // Averages each 2x2 block of the U and V planes into chroma
+        void subsample()
+        {
+            size_t plane = (size_t)width * height;
+            uint32_t cw = (width + 1) / 2, ch = (height + 1) / 2;
+            for (int p = 0; p < 2; ++p)
+            {
+                const uint8_t *src = &frame[plane * (1 + p)];
+                uint8_t *dst = &chroma[(size_t)cw * ch * p];
+                for (uint32_t y = 0; y < ch; ++y)
+                {
+                    const uint8_t *r0 = src + (size_t)(2 * y) * width;
+                    const uint8_t *r1 = 2 * y + 1 < height ? r0 + width : r0;
+                    for (uint32_t x = 0; x < cw; ++x)
+                    {
+                        uint32_t x1 = 2 * x + 1 < width ? 2 * x + 1 : 2 * x;
+                        dst[(size_t)y * cw + x] = (uint8_t)((r0[2 * x] + r0[x1] + r1[2 * x] + r1[x1] + 2) >> 2);
+                    }
+                }
+            }
+        }
+    };
+}
@@ -1,5 +1,5 @@
 // main.cpp
-// Full-featured minimal pixel editor (SDL2 + SDL2_ttf + stb_image_write)
+// Full-featured minimal pixel editor (SDL2 + SDL2_ttf)
 // - Tools: pencil, eraser, eyedropper, fill
 // - Palette, toolbar, grid, checkerboard
 // - Zoom & pan, frames, onion-skin, undo/redo
@@ -8,9 +8,8 @@
 // Requires: SDL2, SDL2_ttf
 //
 // Compile (Linux):
-// g++ main.cpp -O2 -std=c++17 -lSDL2 -lSDL2_ttf -o pixel_editor
+// g++ main.cpp -O2 -std=c++17 -pthread -lSDL2 -lSDL2_ttf -o pixel_editor
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <vector>
 #include <string>
 #include <cstring>
@@ -23,7 +22,15 @@
 #include <deque>
 #include <fstream>
 #include <iostream>
-#include "stb_image_write.h"
+#include <list>
+#include <thread>
+#include "pix_import.h"
+#include "pix_jobs.h"
+#include "pix_png.h"
+#include "pix_profile.h"
+#include "pix_project.h"
+#include "pix_trace.h"
+#include "pix_upscale.h"
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
@@ -47,6 +54,8 @@ const int STATUS_H = 26;
 const int PALETTE_SWATCH = 28;
 
 // ----------------- Utility -----------------
+// Packed pixel, r in the low byte: in memory (little-endian) it is the bytes
+// R, G, B, A, so frame buffers go to PNG encoders and RGBA32 textures as is
 static inline uint32_t rgba_u(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255)
 {
     return (uint32_t)r | ((uint32_t)g << 8) | ((uint32_t)b << 16) | ((uint32_t)a << 24);
@@ -74,14 +83,52 @@ enum Tool
 };
 
 // ----------------- Frame & Sprite -----------------
+// content stamps for frames, unique across every edit so a texture that holds
+// stamp N is known to match any frame (or copy of one) with stamp N
+static inline uint64_t next_frame_rev()
+{
+    static uint64_t rev = 0;
+    return ++rev;
+}
+
 struct Frame
 {
     int w, h;
     std::vector<uint32_t> px; // RGBA
-    Frame() : w(0), h(0) {}
-    Frame(int W, int H, uint32_t fill = rgba_u(0, 0, 0, 0)) : w(W), h(H), px(W * H, fill) {}
+    // texture upload tracking: pixels changed since clean_rev lie in the dirty rect
+    uint64_t rev, clean_rev = 0;
+    int dirty_x0 = 0, dirty_y0 = 0, dirty_x1 = -1, dirty_y1 = -1;
+    Frame() : w(0), h(0), rev(next_frame_rev()) {}
+    Frame(int W, int H, uint32_t fill = rgba_u(0, 0, 0, 0)) : w(W), h(H), px(W * H, fill), rev(next_frame_rev()) {}
     inline uint32_t &at(int x, int y) { return px[y * w + x]; }
     inline const uint32_t &at(int x, int y) const { return px[y * w + x]; }
+    inline void set(int x, int y, uint32_t c)
+    {
+        at(x, y) = c;
+        mark_dirty(x, y);
+        pixprof::count(pixprof::COUNT_PIXELS);
+    }
+    void mark_dirty(int x, int y)
+    {
+        if (dirty_x1 < dirty_x0)
+        {
+            dirty_x0 = dirty_x1 = x;
+            dirty_y0 = dirty_y1 = y;
+        }
+        else
+        {
+            dirty_x0 = std::min(dirty_x0, x);
+            dirty_y0 = std::min(dirty_y0, y);
+            dirty_x1 = std::max(dirty_x1, x);
+            dirty_y1 = std::max(dirty_y1, y);
+        }
+        rev = next_frame_rev();
+    }
+    void mark_clean()
+    {
+        clean_rev = rev;
+        dirty_x1 = dirty_x0 - 1;
+    }
 };
 
 struct Sprite
@@ -158,6 +205,8 @@ int play_frame_index = 0;
 bool onion_skin = true;
 int onion_prev = 1; // how many frames previous to show
 int onion_next = 1;
+int export_scale = 1; // upscale factor for PNG exports
+pixup::Mode export_mode = pixup::MODE_NEAREST;
 
 UndoStack undo_stack;
 
@@ -202,6 +251,7 @@ bool screen_to_canvas(int sx, int sy, int &cx, int &cy, int canvas_origin_x, int
 
 void flood_fill(Frame &f, int sx, int sy, uint32_t target, uint32_t repl)
 {
+    PIX_TRACE_SCOPE("flood_fill");
     if (target == repl)
         return;
     if (sx < 0 || sy < 0 || sx >= f.w || sy >= f.h)
@@ -218,7 +268,7 @@ void flood_fill(Frame &f, int sx, int sy, uint32_t target, uint32_t repl)
             continue;
         if (f.at(x, y) != target)
             continue;
-        f.at(x, y) = repl;
+        f.set(x, y, repl);
         stack.emplace_back(x + 1, y);
         stack.emplace_back(x - 1, y);
         stack.emplace_back(x, y + 1);
@@ -226,103 +276,215 @@ void flood_fill(Frame &f, int sx, int sy, uint32_t target, uint32_t repl)
     }
 }
 
-// export sprite frames horizontally into PNG using stb_image_write
-bool export_spritesheet(const Sprite &s, const char *path)
+// collect the colours of every frame, so a sheet of at most 256 colours
+// is written as an indexed PNG
+void sheet_colors(const Sprite &s, pixpng::Palette &colors)
 {
+    for (auto &fr : s.frames)
+        if (!colors.add(fr.px.data(), fr.px.size()))
+            break;
+    colors.finish();
+}
+
+// export an upscaled sheet: source rows are processed in small bands, each
+// band upscaled in parallel across frames and streamed straight to the PNG
+bool export_spritesheet_scaled(const Sprite &s, const char *path, int scale, pixup::Mode mode)
+{
+    PIX_TRACE_SCOPE("export_spritesheet_scaled");
+    scale = std::max(1, std::min(pixup::MAX_SCALE, scale));
+    int fc = (int)s.frames.size();
+    int W = s.w * scale * fc;
+    int H = s.h * scale;
+    pixpng::Palette colors;
+    if (pixup::preservesColors(mode))
+        sheet_colors(s, colors);
+    pixpng::Writer png;
+    if (!png.open(path, W, H, &colors))
+        return false;
+
+    const int BAND = 8;
+    std::vector<uint32_t> band((size_t)BAND * scale * W);
+
+    for (int y0 = 0; y0 < s.h; y0 += BAND)
+    {
+        int rows = std::min(BAND, s.h - y0);
+        // each frame fills its own column of the band
+        pixjobs::pool().parallelFor(pixjobs::PRIORITY_BACKGROUND, (size_t)fc, [&](size_t fi)
+                                    {
+            pixup::Scratch scratch;
+            uint32_t *out[pixup::MAX_SCALE];
+            const Frame &fr = s.frames[fi];
+            for (int y = y0; y < y0 + rows; ++y)
+            {
+                const uint32_t *cur = &fr.at(0, y);
+                const uint32_t *up = y > 0 ? cur - fr.w : cur;
+                const uint32_t *down = y < s.h - 1 ? cur + fr.w : cur;
+                for (int r = 0; r < scale; ++r)
+                    out[r] = band.data() + ((size_t)(y - y0) * scale + r) * W + fi * s.w * scale;
+                pixup::upscaleRow(mode, scale, up, cur, down, s.w, out, scratch);
+            } }, "upscale_band");
+
+        for (int r = 0; r < rows * scale; ++r)
+            png.writePixels(band.data() + (size_t)r * W);
+    }
+    return png.close();
+}
+
+// export sprite frames horizontally into PNG. Each sheet row is gathered
+// from the frames' rows with one memcpy per frame and streamed out, so the
+// only staging memory is a single row.
+bool export_spritesheet(const Sprite &s, const char *path, int scale = 1, pixup::Mode mode = pixup::MODE_NEAREST)
+{
+    PIX_TRACE_SCOPE("export_spritesheet");
     if (s.frames.empty())
         return false;
+    if (scale > 1)
+        return export_spritesheet_scaled(s, path, scale, mode);
     int W = s.w * (int)s.frames.size();
     int H = s.h;
-    std::vector<uint8_t> out(W * H * 4);
-    for (int fi = 0; fi < (int)s.frames.size(); ++fi)
+    pixpng::Palette colors;
+    sheet_colors(s, colors);
+    pixpng::Writer png;
+    if (!png.open(path, W, H, &colors))
+        return false;
+    std::vector<uint32_t> row(W);
+    for (int y = 0; y < H; ++y)
     {
-        const Frame &fr = s.frames[fi];
-        for (int y = 0; y < s.h; ++y)
-        {
-            for (int x = 0; x < s.w; ++x)
-            {
-                uint32_t c = fr.at(x, y);
-                int ox = fi * s.w + x;
-                int idx = 4 * (y * W + ox);
-                out[idx + 0] = r_of(c);
-                out[idx + 1] = g_of(c);
-                out[idx + 2] = b_of(c);
-                out[idx + 3] = a_of(c);
-            }
-        }
+        for (size_t fi = 0; fi < s.frames.size(); ++fi)
+            std::memcpy(&row[fi * s.w], &s.frames[fi].at(0, y), sizeof(uint32_t) * s.w);
+        if (!png.writePixels(row.data()))
+            return false;
     }
-    int ok = stbi_write_png(path, W, H, 4, out.data(), W * 4);
-    return ok != 0;
+    return png.close();
 }
 
-// save project (simple binary: w,h,framecount, then raw uint32 pixels per frame)
+// Project files go through pix_project.h: saved as PXL2 (frames
+// delta-coded against periodic keyframes); PXL1 and the SFML build's .pix
+// files load too.
 bool save_project(const Sprite &s, const char *path)
 {
-    std::ofstream ofs(path, std::ios::binary);
-    if (!ofs)
+    PIX_TRACE_SCOPE("save_project");
+    pixproj::Info info;
+    info.format = pixproj::FORMAT_PXL2;
+    info.width = s.w;
+    info.height = s.h;
+    info.frames = (uint32_t)s.frames.size();
+    pixproj::Writer out;
+    if (!out.open(path, info))
         return false;
-    ofs.write("PXL1", 4);
-    int32_t w = s.w, h = s.h;
-    int32_t fc = (int32_t)s.frames.size();
-    ofs.write((char *)&w, sizeof(w));
-    ofs.write((char *)&h, sizeof(h));
-    ofs.write((char *)&fc, sizeof(fc));
     for (auto &fr : s.frames)
+        out.add((const uint8_t *)fr.px.data());
+    return out.close();
+}
+bool load_project(Sprite &s, const char *path)
+{
+    PIX_TRACE_SCOPE("load_project");
+    pixproj::Reader in;
+    if (!in.open(path))
+    {
+        std::printf("Cannot load %s: %s\n", path, in.error().c_str());
+        return false;
+    }
+    const pixproj::Info &info = in.header();
+    std::vector<Frame> frames;
+    frames.reserve(info.frames);
+    std::string name; // the SDL build has no frame names
+    while (!in.done())
     {
-        ofs.write((char *)fr.px.data(), sizeof(uint32_t) * fr.w * fr.h);
+        // decoded straight into the frame's pixels
+        frames.emplace_back((int)info.width, (int)info.height);
+        if (!in.nextRGBA(frames.back().px.data(), name))
+        {
+            std::printf("Cannot load %s: %s\n", path, in.error().c_str());
+            return false;
+        }
     }
+    s.w = (int)info.width;
+    s.h = (int)info.height;
+    s.frames = std::move(frames);
+    s.cur_frame = 0;
     return true;
 }
-bool load_project(Sprite &s, const char *path)
+
+// import PNGs (pix_import.h): a directory of PNGs becomes one frame per
+// file, each decoded in parallel straight into its frame; a single PNG is
+// a spritesheet, sliced automatically
+bool import_png(Sprite &s, const char *path)
 {
-    std::ifstream ifs(path, std::ios::binary);
-    if (!ifs)
-        return false;
-    char hdr[4];
-    ifs.read(hdr, 4);
-    if (std::strncmp(hdr, "PXL1", 4) != 0)
-        return false;
-    int32_t w, h, fc;
-    ifs.read((char *)&w, sizeof(w));
-    ifs.read((char *)&h, sizeof(h));
-    ifs.read((char *)&fc, sizeof(fc));
-    if (w <= 0 || h <= 0 || fc <= 0)
-        return false;
-    s.w = w;
-    s.h = h;
-    s.frames.clear();
-    for (int i = 0; i < fc; i++)
+    PIX_TRACE_SCOPE("import_png");
+    std::vector<std::string> files = piximport::filesAt(path);
+    std::vector<Frame> frames;
+    uint32_t w = 0, h = 0;
+    std::string error = "no PNG files";
+    if (files.size() > 1)
+    {
+        piximport::Sequence seq;
+        if (seq.open(files))
+        {
+            w = seq.width;
+            h = seq.height;
+            for (size_t i = 0; i < files.size(); ++i)
+                frames.emplace_back((int)w, (int)h);
+            if (!seq.decode([&](size_t i)
+                            { return frames[i].px.data(); }))
+                frames.clear();
+        }
+        error = seq.error();
+    }
+    else if (files.size() == 1)
     {
-        Frame fr(w, h);
-        ifs.read((char *)fr.px.data(), sizeof(uint32_t) * w * h);
-        s.frames.push_back(std::move(fr));
+        piximport::Sheet sheet;
+        if (sheet.load(files[0]))
+        {
+            std::vector<piximport::Rect> cells = sheet.slice();
+            piximport::Sheet::frameSize(cells, w, h);
+            for (size_t i = 0; i < cells.size(); ++i)
+                frames.emplace_back((int)w, (int)h);
+            pixjobs::pool().parallelFor(pixjobs::PRIORITY_INTERACTIVE, cells.size(), [&](size_t i)
+                                        { sheet.copy(cells[i], frames[i].px.data(), w, h); }, "import_cell");
+            error = "no frames found";
+        }
+        else
+            error = sheet.error();
     }
+    if (frames.empty())
+    {
+        std::printf("Cannot import %s: %s\n", path, error.c_str());
+        return false;
+    }
+    s.w = (int)w;
+    s.h = (int)h;
+    s.frames = std::move(frames);
     s.cur_frame = 0;
     return true;
 }
 
-// save PNG of current visible composited frame with checkerboard compositing
-bool save_png_current(const Sprite &s, const char *path)
+// save PNG of the current frame, straight from its pixel buffer (indexed
+// when it has at most 256 colours), upscaled like the sheet export
+bool save_png_current(const Sprite &s, const char *path, int scale = 1, pixup::Mode mode = pixup::MODE_NEAREST)
 {
+    PIX_TRACE_SCOPE("save_png_current");
     if (s.frames.empty())
         return false;
     const Frame &fr = s.frames[s.cur_frame];
-    int W = fr.w, H = fr.h;
-    std::vector<uint8_t> out(W * H * 4);
-    for (int y = 0; y < H; ++y)
+    scale = std::max(1, std::min(pixup::MAX_SCALE, scale));
+    if (scale == 1)
+        return pixpng::writeImage(path, fr.px.data(), fr.w, fr.h, fr.w);
+
+    // upscaled rows stream straight to the PNG
+    pixpng::Palette colors;
+    if (pixup::preservesColors(mode))
     {
-        for (int x = 0; x < W; ++x)
-        {
-            uint32_t c = fr.at(x, y);
-            int idx = 4 * (y * W + x);
-            out[idx + 0] = r_of(c);
-            out[idx + 1] = g_of(c);
-            out[idx + 2] = b_of(c);
-            out[idx + 3] = a_of(c);
-        }
+        colors.add(fr.px.data(), fr.px.size());
+        colors.finish();
     }
-    int ok = stbi_write_png(path, W, H, 4, out.data(), W * 4);
-    return ok != 0;
+    pixpng::Writer png;
+    if (!png.open(path, fr.w * scale, fr.h * scale, &colors))
+        return false;
+    bool ok = pixup::upscaleImage(mode, scale, fr.px.data(), fr.w, fr.h, fr.w,
+                                  [&](const uint32_t *row)
+                                  { return png.writePixels(row); });
+    return png.close() && ok;
 }
 
 // ----------------- Drawing helpers -----------------
@@ -335,22 +497,121 @@ void draw_rect(SDL_Renderer *ren, int x, int y, int w, int h, SDL_Color col, boo
         SDL_RenderFillRect(ren, &r);
     else
         SDL_RenderDrawRect(ren, &r);
+    pixprof::count(pixprof::COUNT_DRAWS);
 }
 
-void draw_checkerboard(SDL_Renderer *ren, int x0, int y0, int wpx, int hpx, int px_size)
+// ----------------- Frame textures -----------------
+// One streaming texture per frame slot, shared by the canvas, the onion skin
+// and the timeline thumbnails. Only the frame's dirty rect is re-uploaded, so
+// each frame costs one SDL_RenderCopy however large the sprite is.
+struct FrameTextures
 {
-    // small 2x2 checker for transparent background
-    for (int y = 0; y < hpx; ++y)
+    struct Slot
+    {
+        SDL_Texture *tex = nullptr;
+        int w = 0, h = 0;
+        uint64_t rev = NO_REV;
+    };
+    // held by a slot whose texture has no defined contents yet; no frame
+    // ever has it, so the first upload always covers the whole frame
+    static constexpr uint64_t NO_REV = UINT64_MAX;
+    std::vector<Slot> slots;
+    SDL_Texture *checker = nullptr;
+    int checker_w = 0, checker_h = 0;
+
+    SDL_Texture *get(SDL_Renderer *ren, int i, Frame &fr)
     {
-        for (int x = 0; x < wpx; ++x)
+        if ((int)slots.size() <= i)
+            slots.resize(i + 1);
+        Slot &s = slots[i];
+        if (s.tex && (s.w != fr.w || s.h != fr.h))
+        {
+            SDL_DestroyTexture(s.tex);
+            s.tex = nullptr;
+        }
+        if (!s.tex)
+        {
+            s.tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, fr.w, fr.h);
+            if (!s.tex)
+                return nullptr;
+            SDL_SetTextureBlendMode(s.tex, SDL_BLENDMODE_BLEND);
+            s.w = fr.w;
+            s.h = fr.h;
+            s.rev = NO_REV;
+        }
+        if (s.rev != fr.rev)
         {
-            bool alt = ((x / 2 + y / 2) & 1);
-            uint8_t v = alt ? 240 : 220;
-            SDL_SetRenderDrawColor(ren, v, v, v, 255);
-            SDL_Rect r = {x0 + x * px_size, y0 + y * px_size, px_size, px_size};
-            SDL_RenderFillRect(ren, &r);
+            // partial upload only if the texture holds exactly the pixels the dirty rect is relative to
+            SDL_Rect r = {0, 0, fr.w, fr.h};
+            if (s.rev == fr.clean_rev && fr.dirty_x1 >= fr.dirty_x0)
+                r = {fr.dirty_x0, fr.dirty_y0, fr.dirty_x1 - fr.dirty_x0 + 1, fr.dirty_y1 - fr.dirty_y0 + 1};
+            pixprof::Scope scope(pixprof::PHASE_UPLOAD);
+            pixprof::count(pixprof::COUNT_UPLOADS);
+            void *pixels;
+            int pitch;
+            if (SDL_LockTexture(s.tex, &r, &pixels, &pitch) != 0)
+                return s.tex;
+            for (int y = 0; y < r.h; ++y)
+                std::memcpy((uint8_t *)pixels + (size_t)y * pitch, &fr.px[(size_t)(r.y + y) * fr.w + r.x], sizeof(uint32_t) * r.w);
+            SDL_UnlockTexture(s.tex);
+            s.rev = fr.rev;
+            fr.mark_clean();
         }
+        return s.tex;
     }
+
+    // SDL_Renderer has no wrap addressing, so the 2x2-pixel checker is baked
+    // once per canvas size at one texel per canvas pixel and stretched
+    SDL_Texture *checkerboard(SDL_Renderer *ren, int w, int h)
+    {
+        if (checker && checker_w == w && checker_h == h)
+            return checker;
+        if (checker)
+            SDL_DestroyTexture(checker);
+        checker = SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, w, h);
+        if (!checker)
+            return nullptr;
+        checker_w = w;
+        checker_h = h;
+        std::vector<uint32_t> px((size_t)w * h);
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x)
+            {
+                uint8_t v = ((x / 2 + y / 2) & 1) ? 240 : 220;
+                px[(size_t)y * w + x] = rgba_u(v, v, v, 255);
+            }
+        SDL_UpdateTexture(checker, nullptr, px.data(), w * (int)sizeof(uint32_t));
+        return checker;
+    }
+
+    // drop textures of frames that no longer exist
+    void trim(size_t n)
+    {
+        for (size_t i = n; i < slots.size(); ++i)
+            if (slots[i].tex)
+                SDL_DestroyTexture(slots[i].tex);
+        if (slots.size() > n)
+            slots.resize(n);
+    }
+
+    void release()
+    {
+        trim(0);
+        if (checker)
+            SDL_DestroyTexture(checker);
+        checker = nullptr;
+    }
+};
+
+void draw_checkerboard(SDL_Renderer *ren, FrameTextures &textures, int x0, int y0, int wpx, int hpx, int px_size)
+{
+    // small 2x2 checker for transparent background
+    SDL_Texture *tex = textures.checkerboard(ren, wpx, hpx);
+    if (!tex)
+        return;
+    SDL_Rect dst = {x0, y0, wpx * px_size, hpx * px_size};
+    SDL_RenderCopy(ren, tex, nullptr, &dst);
+    pixprof::count(pixprof::COUNT_DRAWS);
 }
 
 void draw_pixel_grid(SDL_Renderer *ren, int x0, int y0, int wpx, int hpx, int px_size, SDL_Color grid_col)
@@ -369,21 +630,230 @@ void draw_pixel_grid(SDL_Renderer *ren, int x0, int y0, int wpx, int hpx, int px
         int y = y0 + j * px_size;
         SDL_RenderDrawLine(ren, x0, y, x0 + wpx * px_size, y);
     }
+    pixprof::count(pixprof::COUNT_DRAWS, wpx + hpx + 2);
 }
 
+// ----------------- Text -----------------
+// Printable ASCII is rasterized once per font into a glyph atlas and strings
+// are drawn as runs of textured quads from it, which SDL's render batching
+// submits together. Text with other characters falls back to whole-label
+// textures kept in a small LRU cache. Both are rendered white and tinted
+// with the texture colour/alpha mod, so steady-state text allocates nothing.
+struct TextCache
+{
+    static const int FIRST = 32, LAST = 126;
+    static const int ATLAS_W = 256;
+    struct Glyph
+    {
+        SDL_Rect src = {0, 0, 0, 0};
+        int advance = 0;
+    };
+    struct Atlas
+    {
+        TTF_Font *font = nullptr;
+        SDL_Texture *tex = nullptr;
+        Glyph glyphs[LAST - FIRST + 1];
+    };
+    struct Label
+    {
+        TTF_Font *font;
+        std::string text;
+        SDL_Texture *tex;
+        int w, h;
+    };
+
+    std::vector<Atlas> atlases; // one per font (and so per size)
+    std::list<Label> labels;    // most recently used first
+    size_t max_labels = 64;
+
+    Atlas &atlas(SDL_Renderer *ren, TTF_Font *font)
+    {
+        for (auto &a : atlases)
+            if (a.font == font)
+                return a;
+        atlases.emplace_back();
+        Atlas &a = atlases.back();
+        a.font = font;
+
+        // render every glyph, then shelf-pack them into rows of ATLAS_W
+        const SDL_Color white = {255, 255, 255, 255};
+        SDL_Surface *surfs[LAST - FIRST + 1] = {};
+        int x = 0, y = 0, row_h = 0;
+        for (int c = FIRST; c <= LAST; ++c)
+        {
+            Glyph &g = a.glyphs[c - FIRST];
+            int minx, maxx, miny, maxy;
+            if (TTF_GlyphMetrics(font, (Uint16)c, &minx, &maxx, &miny, &maxy, &g.advance) != 0)
+                g.advance = 0;
+            SDL_Surface *rendered = TTF_RenderGlyph_Blended(font, (Uint16)c, white);
+            if (!rendered)
+                continue;
+            SDL_Surface *surf = SDL_ConvertSurfaceFormat(rendered, SDL_PIXELFORMAT_RGBA32, 0);
+            SDL_FreeSurface(rendered);
+            if (!surf)
+                continue;
+            if (x + surf->w > ATLAS_W)
+            {
+                x = 0;
+                y += row_h + 1;
+                row_h = 0;
+            }
+            g.src = {x, y, surf->w, surf->h};
+            x += surf->w + 1;
+            row_h = std::max(row_h, surf->h);
+            surfs[c - FIRST] = surf;
+        }
+        int atlas_h = std::max(1, y + row_h);
+
+        std::vector<uint32_t> px((size_t)ATLAS_W * atlas_h, 0);
+        for (int i = 0; i <= LAST - FIRST; ++i)
+        {
+            SDL_Surface *surf = surfs[i];
+            if (!surf)
+                continue;
+            const SDL_Rect &r = a.glyphs[i].src;
+            for (int row = 0; row < r.h; ++row)
+                std::memcpy(&px[(size_t)(r.y + row) * ATLAS_W + r.x], (const uint8_t *)surf->pixels + (size_t)row * surf->pitch, sizeof(uint32_t) * r.w);
+            SDL_FreeSurface(surf);
+        }
+        a.tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, ATLAS_W, atlas_h);
+        if (a.tex)
+        {
+            SDL_SetTextureBlendMode(a.tex, SDL_BLENDMODE_BLEND);
+            SDL_UpdateTexture(a.tex, nullptr, px.data(), ATLAS_W * (int)sizeof(uint32_t));
+        }
+        return a;
+    }
+
+    const Label *label(SDL_Renderer *ren, TTF_Font *font, const std::string &text)
+    {
+        for (auto it = labels.begin(); it != labels.end(); ++it)
+        {
+            if (it->font == font && it->text == text)
+            {
+                labels.splice(labels.begin(), labels, it);
+                return &labels.front();
+            }
+        }
+        SDL_Surface *surf = TTF_RenderUTF8_Blended(font, text.c_str(), {255, 255, 255, 255});
+        if (!surf)
+            return nullptr;
+        SDL_Texture *tex = SDL_CreateTextureFromSurface(ren, surf);
+        Label l = {font, text, tex, surf->w, surf->h};
+        SDL_FreeSurface(surf);
+        if (!tex)
+            return nullptr;
+        SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+        labels.push_front(l);
+        while (labels.size() > max_labels)
+        {
+            SDL_DestroyTexture(labels.back().tex);
+            labels.pop_back();
+        }
+        return &labels.front();
+    }
+
+    void draw(SDL_Renderer *ren, TTF_Font *font, const std::string &text, int x, int y, SDL_Color col)
+    {
+        bool ascii = std::all_of(text.begin(), text.end(), [](char c)
+                                 { return c >= FIRST && c <= LAST; });
+        if (ascii)
+        {
+            Atlas &a = atlas(ren, font);
+            if (!a.tex)
+                return;
+            SDL_SetTextureColorMod(a.tex, col.r, col.g, col.b);
+            SDL_SetTextureAlphaMod(a.tex, col.a);
+            int pen = x;
+            for (char c : text)
+            {
+                const Glyph &g = a.glyphs[c - FIRST];
+                if (g.src.w > 0)
+                {
+                    SDL_Rect dst = {pen, y, g.src.w, g.src.h};
+                    SDL_RenderCopy(ren, a.tex, &g.src, &dst);
+                    pixprof::count(pixprof::COUNT_DRAWS);
+                }
+                pen += g.advance;
+            }
+            return;
+        }
+        const Label *l = label(ren, font, text);
+        if (!l)
+            return;
+        SDL_SetTextureColorMod(l->tex, col.r, col.g, col.b);
+        SDL_SetTextureAlphaMod(l->tex, col.a);
+        SDL_Rect dst = {x, y, l->w, l->h};
+        SDL_RenderCopy(ren, l->tex, nullptr, &dst);
+        pixprof::count(pixprof::COUNT_DRAWS);
+    }
+
+    void release()
+    {
+        for (auto &a : atlases)
+            if (a.tex)
+                SDL_DestroyTexture(a.tex);
+        atlases.clear();
+        for (auto &l : labels)
+            SDL_DestroyTexture(l.tex);
+        labels.clear();
+    }
+};
+
+TextCache text_cache;
+
 // draw small text using SDL_ttf
 void draw_text(SDL_Renderer *ren, TTF_Font *font, const std::string &text, int x, int y, SDL_Color col)
 {
     if (!font)
         return;
-    SDL_Surface *surf = TTF_RenderUTF8_Blended(font, text.c_str(), col);
-    if (!surf)
-        return;
-    SDL_Texture *tex = SDL_CreateTextureFromSurface(ren, surf);
-    SDL_Rect dst = {x, y, surf->w, surf->h};
-    SDL_RenderCopy(ren, tex, nullptr, &dst);
-    SDL_DestroyTexture(tex);
-    SDL_FreeSurface(surf);
+    text_cache.draw(ren, font, text, x, y, col);
+}
+
+// Profiler HUD: per-phase times, counters and a stacked frame-time history
+void draw_profiler_hud(SDL_Renderer *ren, TTF_Font *font)
+{
+    const pixprof::Profiler &prof = pixprof::profiler();
+    const int bar_w = 2, graph_h = 60;
+    const float ms_scale = graph_h / 33.3f; // two 60 Hz frames fill the graph
+    SDL_Rect r = {8, STATUS_H + 8, pixprof::HISTORY * bar_w + 16, 265};
+    draw_rect(ren, r.x, r.y, r.w, r.h, {0, 0, 0, 190});
+
+    std::string text = prof.summary();
+    int line_y = r.y + 6;
+    for (size_t start = 0, end; (end = text.find('\n', start)) != std::string::npos; start = end + 1)
+    {
+        draw_text(ren, font, text.substr(start, end - start), r.x + 8, line_y, {220, 220, 220, 255});
+        line_y += 15;
+    }
+
+    // one stacked bar per frame, phases bottom-up, one fill call per phase
+    std::vector<SDL_Rect> bars[pixprof::PHASE_COUNT];
+    int base_y = r.y + r.h - 8;
+    for (int i = 0; i < pixprof::HISTORY; ++i)
+    {
+        int f = (prof.head + i) % pixprof::HISTORY;
+        int y = base_y;
+        for (int p = 0; p < pixprof::PHASE_COUNT; ++p)
+        {
+            int h = std::min((int)(prof.phaseMs[f][p] * ms_scale + 0.5f), y - (base_y - graph_h));
+            if (h <= 0)
+                continue;
+            bars[p].push_back({r.x + 8 + i * bar_w, y - h, bar_w, h});
+            y -= h;
+        }
+    }
+    for (int p = 0; p < pixprof::PHASE_COUNT; ++p)
+    {
+        if (bars[p].empty())
+            continue;
+        uint32_t c = pixprof::phaseColor(p);
+        SDL_SetRenderDrawColor(ren, (c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF, 255);
+        SDL_RenderFillRects(ren, bars[p].data(), (int)bars[p].size());
+        pixprof::count(pixprof::COUNT_DRAWS);
+    }
+    // 16.7 ms reference line
+    draw_rect(ren, r.x + 8, base_y - (int)(16.7f * ms_scale), pixprof::HISTORY * bar_w, 1, {255, 255, 255, 120});
 }
 
 // draw a simple icon for tool
@@ -482,6 +952,10 @@ int main(int argc, char **argv)
 {
     (void)argc;
     (void)argv;
+    // PIX_TRACE=1 records a trace from launch; F4 starts/stops one later
+    pixtrace::setThreadName("main");
+    if (std::getenv("PIX_TRACE"))
+        pixtrace::start();
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) != 0)
     {
         std::fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
@@ -512,6 +986,8 @@ int main(int argc, char **argv)
         std::fprintf(stderr, "Renderer create failed: %s\n", SDL_GetError());
         return 1;
     }
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0"); // nearest-neighbour zoom
+    FrameTextures textures;
 
     TTF_Font *font = TTF_OpenFont("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf", 14);
     if (!font)
@@ -546,17 +1022,24 @@ int main(int argc, char **argv)
         auto now = high_resolution_clock::now();
         double dt = duration<double>(now - prev_time).count();
         prev_time = now;
+        pixprof::profiler().frame();
+        pixprof::phase(pixprof::PHASE_EVENTS);
 
         // playback
         if (playing && sprite.frames.size() > 0)
         {
             play_accum += dt;
             double frame_time = 1.0 / std::max(1.0, play_fps);
+            int advanced = 0;
             while (play_accum >= frame_time)
             {
                 play_accum -= frame_time;
                 sprite.cur_frame = (sprite.cur_frame + 1) % (int)sprite.frames.size();
+                ++advanced;
             }
+            // frames stepped over within one redraw were never shown
+            if (advanced > 1)
+                pixprof::count(pixprof::COUNT_DROPPED, advanced - 1);
         }
 
         while (SDL_PollEvent(&e))
@@ -686,7 +1169,7 @@ int main(int argc, char **argv)
                     else if (mx >= export_btn.x && mx <= export_btn.x + export_btn.w && my >= export_btn.y && my <= export_btn.y + export_btn.h)
                     {
                         // export spritesheet
-                        export_spritesheet(sprite, "spritesheet.png");
+                        export_spritesheet(sprite, "spritesheet.png", export_scale, export_mode);
                         std::puts("Exported spritesheet.png");
                     }
                 }
@@ -695,19 +1178,20 @@ int main(int argc, char **argv)
                 int cx, cy;
                 if (screen_to_canvas(mx, my, cx, cy, canvas_x, canvas_y))
                 {
+                    pixprof::Scope tool_scope(pixprof::PHASE_TOOLS);
                     // save for undo
                     undo_stack.push(sprite.frames[sprite.cur_frame]);
 
                     Frame &fr = sprite.frames[sprite.cur_frame];
                     if (cur_tool == TOOL_PENCIL)
                     {
-                        fr.at(cx, cy) = cur_color;
+                        fr.set(cx, cy, cur_color);
                         last_paint_x = cx;
                         last_paint_y = cy;
                     }
                     else if (cur_tool == TOOL_ERASER)
                     {
-                        fr.at(cx, cy) = rgba_u(0, 0, 0, 0);
+                        fr.set(cx, cy, rgba_u(0, 0, 0, 0));
                         last_paint_x = cx;
                         last_paint_y = cy;
                     }
@@ -765,13 +1249,14 @@ int main(int argc, char **argv)
                     int cx, cy;
                     if (screen_to_canvas(mx, my, cx, cy, canvas_x, canvas_y))
                     {
+                        pixprof::Scope tool_scope(pixprof::PHASE_TOOLS);
                         Frame &fr = sprite.frames[sprite.cur_frame];
                         if (cur_tool == TOOL_PENCIL || (mouse_right_down && cur_tool != TOOL_EYEDROPPER))
                         {
                             // pencil or right-click quick eraser
                             if (last_paint_x != cx || last_paint_y != cy)
                             {
-                                fr.at(cx, cy) = (mouse_right_down ? rgba_u(0, 0, 0, 0) : cur_color);
+                                fr.set(cx, cy, mouse_right_down ? rgba_u(0, 0, 0, 0) : cur_color);
                                 last_paint_x = cx;
                                 last_paint_y = cy;
                             }
@@ -780,7 +1265,7 @@ int main(int argc, char **argv)
                         {
                             if (last_paint_x != cx || last_paint_y != cy)
                             {
-                                fr.at(cx, cy) = rgba_u(0, 0, 0, 0);
+                                fr.set(cx, cy, rgba_u(0, 0, 0, 0));
                                 last_paint_x = cx;
                                 last_paint_y = cy;
                             }
@@ -801,6 +1286,12 @@ int main(int argc, char **argv)
                 SDL_Keycode k = e.key.keysym.sym;
                 if (k == SDLK_p)
                     cur_tool = TOOL_PENCIL;
+                else if (k == SDLK_e && SDL_GetModState() & KMOD_CTRL)
+                {
+                    // export the current frame at the export scale and filter
+                    if (save_png_current(sprite, "frame.png", export_scale, export_mode))
+                        std::puts("Exported frame.png");
+                }
                 else if (k == SDLK_e)
                     cur_tool = TOOL_ERASER;
                 else if (k == SDLK_i)
@@ -831,19 +1322,42 @@ int main(int argc, char **argv)
                     save_project(sprite, "project.pxl");
                     std::puts("Saved project.pxl");
                 }
+                else if (k == SDLK_o && SDL_GetModState() & KMOD_CTRL && SDL_GetModState() & KMOD_SHIFT)
+                {
+                    // import the PNGs in import/
+                    if (import_png(sprite, "import"))
+                    {
+                        std::printf("Imported %d frames\n", (int)sprite.frames.size());
+                        undo_stack.clear();
+                    }
+                }
                 else if (k == SDLK_o && SDL_GetModState() & KMOD_CTRL)
                 {
-                    // load project
-                    if (load_project(sprite, "project.pxl"))
+                    // load project.pxl, or the SFML build's project.pix
+                    if (load_project(sprite, "project.pxl") || load_project(sprite, "project.pix"))
                     {
-                        std::puts("Loaded project.pxl");
+                        std::puts("Loaded project");
                         undo_stack.clear();
                     }
                     else
                     {
-                        std::puts("Failed to load project.pxl");
+                        std::puts("Failed to load project");
                     }
                 }
+                else if (k == SDLK_x)
+                {
+                    // cycle PNG export scale
+                    static const int scales[] = {1, 2, 3, 4, 6, 8};
+                    int i = 0;
+                    while (i < 5 && scales[i] != export_scale)
+                        ++i;
+                    export_scale = scales[(i + 1) % 6];
+                }
+                else if (k == SDLK_m)
+                {
+                    // cycle PNG export upscale filter
+                    export_mode = (pixup::Mode)((export_mode + 1) % pixup::MODE_COUNT);
+                }
                 else if (k == SDLK_SPACE)
                 {
                     // temporary pan tool while space is held
@@ -859,6 +1373,26 @@ int main(int argc, char **argv)
                     // previous frame
                     sprite.cur_frame = (sprite.cur_frame - 1 + (int)sprite.frames.size()) % (int)sprite.frames.size();
                 }
+                else if (k == SDLK_F3)
+                {
+                    // toggle the frame-time profiler HUD
+                    pixprof::profiler().visible = !pixprof::profiler().visible;
+                }
+                else if (k == SDLK_F4)
+                {
+                    // start a trace capture, or stop and write it out
+                    if (!pixtrace::enabled())
+                    {
+                        pixtrace::start();
+                        std::puts("Tracing started");
+                    }
+                    else
+                    {
+                        pixtrace::stop();
+                        if (pixtrace::dump("trace.json"))
+                            std::puts("Wrote trace.json");
+                    }
+                }
                 else if (k == SDLK_ESCAPE)
                 {
                     quit = true;
@@ -875,6 +1409,7 @@ int main(int argc, char **argv)
         }
 
         // Clear screen
+        pixprof::phase(pixprof::PHASE_UI);
         SDL_SetRenderDrawColor(ren, 60, 60, 70, 255);
         SDL_RenderClear(ren);
 
@@ -884,59 +1419,44 @@ int main(int argc, char **argv)
         draw_rect(ren, 0, WINDOW_H - TIMELINE_H, WINDOW_W, TIMELINE_H, {45, 45, 50, 255});           // timeline
 
         // Draw canvas area background
+        pixprof::phase(pixprof::PHASE_CANVAS);
         draw_rect(ren, canvas_x, canvas_y, sprite.w * pixel_size, sprite.h * pixel_size, {30, 30, 35, 255});
 
         // Draw checkerboard pattern for transparency
-        draw_checkerboard(ren, canvas_x, canvas_y, sprite.w, sprite.h, pixel_size);
+        draw_checkerboard(ren, textures, canvas_x, canvas_y, sprite.w, sprite.h, pixel_size);
+
+        textures.trim(sprite.frames.size());
+        SDL_Rect canvas_rect = {canvas_x, canvas_y, sprite.w * pixel_size, sprite.h * pixel_size};
 
         // Draw onion skinning (previous/next frames)
         if (onion_skin && sprite.frames.size() > 1)
         {
-            SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
-
-            // Previous frames
+            int fc = (int)sprite.frames.size();
+            // Previous frames semi-transparent, next frames more transparent
             for (int i = 1; i <= onion_prev; i++)
             {
-                int frame_idx = (sprite.cur_frame - i + (int)sprite.frames.size()) % (int)sprite.frames.size();
-                if (frame_idx != sprite.cur_frame)
+                int frame_idx = (sprite.cur_frame - i + fc) % fc;
+                if (frame_idx == sprite.cur_frame)
+                    continue;
+                if (SDL_Texture *tex = textures.get(ren, frame_idx, sprite.frames[frame_idx]))
                 {
-                    const Frame &fr = sprite.frames[frame_idx];
-                    for (int y = 0; y < sprite.h; y++)
-                    {
-                        for (int x = 0; x < sprite.w; x++)
-                        {
-                            uint32_t c = fr.at(x, y);
-                            if (a_of(c) > 0)
-                            {
-                                SDL_SetRenderDrawColor(ren, r_of(c), g_of(c), b_of(c), 80); // semi-transparent
-                                SDL_Rect r = {canvas_x + x * pixel_size, canvas_y + y * pixel_size, pixel_size, pixel_size};
-                                SDL_RenderFillRect(ren, &r);
-                            }
-                        }
-                    }
+                    SDL_SetTextureAlphaMod(tex, 80);
+                    SDL_RenderCopy(ren, tex, nullptr, &canvas_rect);
+                    SDL_SetTextureAlphaMod(tex, 255);
+                    pixprof::count(pixprof::COUNT_DRAWS);
                 }
             }
-
-            // Next frames
             for (int i = 1; i <= onion_next; i++)
             {
-                int frame_idx = (sprite.cur_frame + i) % (int)sprite.frames.size();
-                if (frame_idx != sprite.cur_frame)
+                int frame_idx = (sprite.cur_frame + i) % fc;
+                if (frame_idx == sprite.cur_frame)
+                    continue;
+                if (SDL_Texture *tex = textures.get(ren, frame_idx, sprite.frames[frame_idx]))
                 {
-                    const Frame &fr = sprite.frames[frame_idx];
-                    for (int y = 0; y < sprite.h; y++)
-                    {
-                        for (int x = 0; x < sprite.w; x++)
-                        {
-                            uint32_t c = fr.at(x, y);
-                            if (a_of(c) > 0)
-                            {
-                                SDL_SetRenderDrawColor(ren, r_of(c), g_of(c), b_of(c), 60); // more transparent
-                                SDL_Rect r = {canvas_x + x * pixel_size, canvas_y + y * pixel_size, pixel_size, pixel_size};
-                                SDL_RenderFillRect(ren, &r);
-                            }
-                        }
-                    }
+                    SDL_SetTextureAlphaMod(tex, 60);
+                    SDL_RenderCopy(ren, tex, nullptr, &canvas_rect);
+                    SDL_SetTextureAlphaMod(tex, 255);
+                    pixprof::count(pixprof::COUNT_DRAWS);
                 }
             }
         }
@@ -944,19 +1464,10 @@ int main(int argc, char **argv)
         // Draw current frame
         if (!sprite.frames.empty())
         {
-            const Frame &fr = sprite.frames[sprite.cur_frame];
-            for (int y = 0; y < sprite.h; y++)
+            if (SDL_Texture *tex = textures.get(ren, sprite.cur_frame, sprite.frames[sprite.cur_frame]))
             {
-                for (int x = 0; x < sprite.w; x++)
-                {
-                    uint32_t c = fr.at(x, y);
-                    if (a_of(c) > 0)
-                    {
-                        SDL_SetRenderDrawColor(ren, r_of(c), g_of(c), b_of(c), a_of(c));
-                        SDL_Rect r = {canvas_x + x * pixel_size, canvas_y + y * pixel_size, pixel_size, pixel_size};
-                        SDL_RenderFillRect(ren, &r);
-                    }
-                }
+                SDL_RenderCopy(ren, tex, nullptr, &canvas_rect);
+                pixprof::count(pixprof::COUNT_DRAWS);
             }
         }
 
@@ -965,6 +1476,7 @@ int main(int argc, char **argv)
         {
             draw_pixel_grid(ren, canvas_x, canvas_y, sprite.w, sprite.h, pixel_size, {80, 80, 90, 100});
         }
+        pixprof::phase(pixprof::PHASE_UI);
 
         // Draw toolbar with tools
         int tbx = toolbar_x(0);
@@ -1033,25 +1545,30 @@ int main(int argc, char **argv)
                 SDL_RenderDrawRect(ren, &thumb_bg);
             }
 
-            // Draw frame thumbnail (scaled down)
-            const Frame &fr = sprite.frames[i];
-            int thumb_scale = std::max(1, std::min(frame_thumb_w / sprite.w, frame_thumb_h / sprite.h));
-            int thumb_px = thumb_scale;
-            int thumb_offset_x = thumb_x + (frame_thumb_w - sprite.w * thumb_px) / 2;
-            int thumb_offset_y = tly + (frame_thumb_h - sprite.h * thumb_px) / 2;
-
-            for (int y = 0; y < sprite.h; y++)
+            // Draw frame thumbnail from the frame's cached texture: integer
+            // scale when it fits, otherwise shrunk to the box keeping aspect
+            int thumb_w = sprite.w, thumb_h = sprite.h;
+            if (thumb_w <= frame_thumb_w && thumb_h <= frame_thumb_h)
             {
-                for (int x = 0; x < sprite.w; x++)
-                {
-                    uint32_t c = fr.at(x, y);
-                    if (a_of(c) > 0)
-                    {
-                        SDL_SetRenderDrawColor(ren, r_of(c), g_of(c), b_of(c), a_of(c));
-                        SDL_Rect r = {thumb_offset_x + x * thumb_px, thumb_offset_y + y * thumb_px, thumb_px, thumb_px};
-                        SDL_RenderFillRect(ren, &r);
-                    }
-                }
+                int thumb_scale = std::max(1, std::min(frame_thumb_w / sprite.w, frame_thumb_h / sprite.h));
+                thumb_w *= thumb_scale;
+                thumb_h *= thumb_scale;
+            }
+            else if (sprite.w * frame_thumb_h > sprite.h * frame_thumb_w)
+            {
+                thumb_w = frame_thumb_w;
+                thumb_h = std::max(1, sprite.h * frame_thumb_w / sprite.w);
+            }
+            else
+            {
+                thumb_h = frame_thumb_h;
+                thumb_w = std::max(1, sprite.w * frame_thumb_h / sprite.h);
+            }
+            SDL_Rect thumb_rect = {thumb_x + (frame_thumb_w - thumb_w) / 2, tly + (frame_thumb_h - thumb_h) / 2, thumb_w, thumb_h};
+            if (SDL_Texture *tex = textures.get(ren, i, sprite.frames[i]))
+            {
+                SDL_RenderCopy(ren, tex, nullptr, &thumb_rect);
+                pixprof::count(pixprof::COUNT_DRAWS);
             }
 
             // Frame number
@@ -1103,6 +1620,7 @@ int main(int argc, char **argv)
             status += " | Size: " + std::to_string(sprite.w) + "x" + std::to_string(sprite.h);
             status += " | Zoom: " + std::to_string(pixel_size) + "x";
             status += " | Color: " + hex_of(cur_color);
+            status += " | Export: " + std::to_string(export_scale) + "x " + pixup::modeName(export_mode);
 
             draw_text(ren, font, status, 8, 4, {220, 220, 220, 255});
         }
@@ -1117,10 +1635,23 @@ int main(int argc, char **argv)
             SDL_RenderDrawRect(ren, &cursor);
         }
 
+        if (pixprof::profiler().visible)
+            draw_profiler_hud(ren, font);
+
+        pixprof::phase(pixprof::PHASE_PRESENT);
         SDL_RenderPresent(ren);
     }
 
+    if (pixtrace::enabled())
+    {
+        pixtrace::stop();
+        if (pixtrace::dump("trace.json"))
+            std::puts("Wrote trace.json");
+    }
+
     // Cleanup
+    textures.release();
+    text_cache.release();
     if (font)
         TTF_CloseFont(font);
     SDL_DestroyRenderer(ren);
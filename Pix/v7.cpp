@@ -1,6 +1,7 @@
 // v2.cpp
 
 #include <SFML/Graphics.hpp>
+#include <SFML/OpenGL.hpp>
 #include <vector>
 #include <string>
 #include <fstream>
@@ -11,9 +12,29 @@
 #include <cstdint>
 #include <cmath>
 #include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include "pix_cexport.h"
+#include "pix_import.h"
+#include "pix_jobs.h"
+#include "pix_layers.h"
+#include "pix_mip.h"
+#include "pix_png.h"
+#include "pix_profile.h"
+#include "pix_project.h"
+#include "pix_tiles.h"
+#include "pix_trace.h"
+#include "pix_upscale.h"
+#include "pix_video.h"
 
 using u8 = sf::Uint8;
 using u32 = uint32_t;
+using u64 = uint64_t;
 
 // Define Color struct FIRST
 struct Color
@@ -49,59 +70,509 @@ namespace EightBitColors
         Blue, Indigo, Pink, Peach};
 }
 
-struct Frame
+// Pixel content of a frame. Copies share their tiles (pix_tiles.h), so a
+// copy is a cheap immutable snapshot that pool threads can read while the
+// frame it came from keeps being edited.
+struct FrameData
 {
-    std::string name = "Frame";
-    sf::Image image;
-    sf::Texture thumbnail;
+    static constexpr unsigned DEFAULT_DURATION = 167; // ms, the old fixed 6 fps
+    static constexpr unsigned MIN_DURATION = 10, MAX_DURATION = 60000;
+    static constexpr unsigned THUMB_SIZE = 48;
 
-    Frame() {}
-    Frame(unsigned w, unsigned h, const std::string &n = "Frame") : name(n)
+    std::string name = "Frame";
+    unsigned duration = DEFAULT_DURATION; // ms on screen during playback
+    pixtile::Plane<u32> rgba;   // RGBA pixels, r in the low byte (released while indexed)
+    pixtile::Plane<u8> indices; // one palette index per pixel in indexed mode
+    bool indexed = false;
+    unsigned width = 0, height = 0;
+
+    // Layer stack (pix_layers.h), bottom first. Empty for a single-layer
+    // frame, which is edited straight in rgba; otherwise edits go to the
+    // active layer and rgba holds their composite (Frame::flatten()).
+    // Indexed frames are never layered.
+    std::vector<pixlayer::Layer> layers;
+    int activeLayer = 0;
+
+    static u32 pack(const sf::Color &c) { return (u32)c.r | (u32)c.g << 8 | (u32)c.b << 16 | (u32)c.a << 24; }
+    static sf::Color unpack(u32 v) { return sf::Color(v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, v >> 24); }
+
+    sf::Color getPixel(unsigned x, unsigned y) const { return unpack(rgba.get(x, y)); }
+    sf::Color getPaintPixel(unsigned x, unsigned y) const { return unpack(paint().get(x, y)); }
+    u8 getIndex(unsigned x, unsigned y) const { return indices.get(x, y); }
+
+    void setDuration(unsigned ms) { duration = std::max(MIN_DURATION, std::min(MAX_DURATION, ms)); }
+
+    // The RGBA pixels edits land in: the active layer, or the frame itself
+    const pixtile::Plane<u32> &paint() const { return layers.empty() ? rgba : layers[activeLayer].px; }
+    pixtile::Plane<u32> &paint() { return layers.empty() ? rgba : layers[activeLayer].px; }
+
+    // Row-major raw pixels: palette indices, or RGBA bytes
+    std::vector<u8> bytes() const
     {
-        image.create(w, h, sf::Color(0, 0, 0, 0));
-        updateThumbnail();
+        if (indexed)
+            return indices.read();
+        std::vector<u8> out((size_t)width * height * 4);
+        rgba.read((u32 *)out.data());
+        return out;
     }
 
-    void clear()
+    // RGBA copy of the frame, looking indices up in palette when indexed
+    sf::Image expand(const std::vector<sf::Color> &palette) const
     {
-        auto s = image.getSize();
-        image.create(s.x, s.y, sf::Color(0, 0, 0, 0));
-        updateThumbnail();
+        sf::Image out;
+        if (!indexed)
+        {
+            std::vector<u32> px = rgba.read();
+            out.create(width, height, (const u8 *)px.data());
+            return out;
+        }
+        std::vector<u8> idx = indices.read();
+        std::vector<u8> px((size_t)width * height * 4);
+        for (size_t i = 0; i < idx.size(); ++i)
+        {
+            sf::Color c = idx[i] < palette.size() ? palette[idx[i]] : sf::Color::Transparent;
+            px[i * 4 + 0] = c.r;
+            px[i * 4 + 1] = c.g;
+            px[i * 4 + 2] = c.b;
+            px[i * 4 + 3] = c.a;
+        }
+        out.create(width, height, px.data());
+        return out;
     }
 
-    sf::Color getPixel(unsigned x, unsigned y) const { return image.getPixel(x, y); }
+    // Indices packed into the red channel, ready for the palette shader
+    sf::Image indexImage() const
+    {
+        std::vector<u8> idx = indices.read();
+        std::vector<u8> px((size_t)width * height * 4, 255);
+        for (size_t i = 0; i < idx.size(); ++i)
+            px[i * 4] = idx[i];
+        sf::Image out;
+        out.create(width, height, px.data());
+        return out;
+    }
 
-    void setPixel(unsigned x, unsigned y, const sf::Color &c)
+    // CPU half of a texture upload: RGBA pixels, or indices in the red
+    // channel as indexImage(); safe to run on a pool thread
+    void texturePixels(std::vector<u32> &out) const
     {
-        image.setPixel(x, y, c);
-        updateThumbnail();
+        out.resize((size_t)width * height);
+        if (!indexed)
+        {
+            rgba.read(out.data());
+            return;
+        }
+        // indices into the tail bytes, then widened front to back
+        u8 *idx = (u8 *)out.data() + out.size() * 3;
+        indices.read(idx);
+        for (size_t i = 0; i < out.size(); ++i)
+            out[i] = 0xFFFFFF00u | idx[i];
     }
 
-    void updateThumbnail()
+    // Point-sampled thumbnail; safe to run on a pool thread
+    sf::Image thumbnailImage() const
     {
         // Create a thumbnail (scaled down version)
-        unsigned thumbSize = 48;
+        PIX_TRACE_SCOPE("thumbnailImage");
+        unsigned thumbSize = THUMB_SIZE;
         sf::Image thumbImg;
         thumbImg.create(thumbSize, thumbSize, sf::Color(0, 0, 0, 0));
 
-        auto size = image.getSize();
-        if (size.x > 0 && size.y > 0)
+        if (width > 0 && height > 0)
         {
             for (unsigned y = 0; y < thumbSize; ++y)
             {
                 for (unsigned x = 0; x < thumbSize; ++x)
                 {
-                    unsigned srcX = (x * size.x) / thumbSize;
-                    unsigned srcY = (y * size.y) / thumbSize;
-                    thumbImg.setPixel(x, y, image.getPixel(srcX, srcY));
+                    unsigned srcX = (x * width) / thumbSize;
+                    unsigned srcY = (y * height) / thumbSize;
+                    if (indexed)
+                        thumbImg.setPixel(x, y, sf::Color(getIndex(srcX, srcY), 0, 0, 255));
+                    else
+                        thumbImg.setPixel(x, y, getPixel(srcX, srcY));
                 }
             }
         }
+        return thumbImg;
+    }
+};
+
+struct Frame : FrameData
+{
+    // Renewed on every pixel change. Revisions are unique across frames,
+    // so two frames share one only when one is a copy of the other.
+    unsigned revision = newRevision();
+    sf::Texture thumbnail;    // RGBA, or palette indices in the red channel when indexed
+    unsigned thumbRevision = ~0u; // revision the thumbnail was built from
+    bool needsFlatten = false;    // layer edited, composite left to Canvas::flattenEdits()
+
+    Frame() {}
+    Frame(unsigned w, unsigned h, const std::string &n = "Frame", bool idx = false)
+    {
+        name = n;
+        indexed = idx;
+        width = w;
+        height = h;
+        if (indexed)
+            indices.create(w, h, 0);
+        else
+            rgba.create(w, h, 0);
+    }
+
+    explicit Frame(const FrameData &d) : FrameData(d) {}
+
+    void clear()
+    {
+        if (indexed)
+            indices.create(width, height, 0);
+        else
+            paint().create(width, height, 0);
+        touch();
+        flatten();
+    }
+
+    void setPixel(unsigned x, unsigned y, const sf::Color &c)
+    {
+        paint().set(x, y, pack(c));
+        pixprof::count(pixprof::COUNT_PIXELS);
+        touch();
+    }
+
+    void setIndex(unsigned x, unsigned y, u8 i)
+    {
+        indices.set(x, y, i);
+        pixprof::count(pixprof::COUNT_PIXELS);
+        touch();
+    }
+
+    // Switch storage to palette indices; map() picks the index for each colour
+    template <class Map>
+    void toIndexed(Map &&map)
+    {
+        if (indexed)
+            return;
+        mergeLayers();
+        std::vector<u32> px = rgba.read();
+        std::vector<u8> idx(px.size());
+        for (size_t i = 0; i < px.size(); ++i)
+            idx[i] = map(unpack(px[i]));
+        indices.create(width, height);
+        indices.write(idx.data());
+        rgba.release();
+        indexed = true;
+        touch();
+    }
+
+    void toRGBA(const std::vector<sf::Color> &palette)
+    {
+        if (!indexed)
+            return;
+        sf::Image img = expand(palette);
+        rgba.create(width, height);
+        rgba.write((const u32 *)img.getPixelsPtr());
+        indices.release();
+        indexed = false;
+        touch();
+    }
+
+    // Immutable view of the pixels, sharing every tile with this frame
+    FrameData snapshot() const { return FrameData(*this); }
+
+    // Recomposites the tiles of rgba whose layers changed; call after
+    // editing a layered frame, before anything reads rgba
+    void flatten()
+    {
+        needsFlatten = false;
+        if (layers.empty())
+            return;
+        PIX_TRACE_SCOPE("flattenLayers");
+        if (flattener.update(layers, rgba))
+            touch();
+    }
+
+    // Starts a blank layer above the active one (turning a single-layer
+    // frame's pixels into its first layer); false for indexed frames
+    bool addLayer()
+    {
+        if (indexed)
+            return false;
+        if (layers.empty())
+        {
+            layers.emplace_back();
+            layers[0].name = "Layer 0";
+            layers[0].px = rgba;
+            activeLayer = 0;
+        }
+        pixlayer::Layer l;
+        l.name = "Layer " + std::to_string(layers.size());
+        l.px.create(width, height, 0);
+        layers.insert(layers.begin() + activeLayer + 1, l);
+        ++activeLayer;
+        flatten();
+        return true;
+    }
+
+    // Drops the active layer; a lone layer left that shows as-is becomes
+    // the frame's pixels again
+    void deleteLayer()
+    {
+        if (layers.size() < 2)
+            return;
+        layers.erase(layers.begin() + activeLayer);
+        activeLayer = std::max(0, activeLayer - 1);
+        if (layers.size() == 1 && layers[0].passThrough())
+            mergeLayers();
+        else
+            flatten();
+    }
+
+    // Moves the active layer up (+1) or down (-1) the stack
+    void moveLayer(int delta)
+    {
+        int to = activeLayer + delta;
+        if (to < 0 || to >= (int)layers.size())
+            return;
+        std::swap(layers[activeLayer], layers[to]);
+        activeLayer = to;
+        flatten();
+    }
+
+    // Restyles the active layer: visibility, opacity, blend mode
+    void styleLayer(bool visible, u8 opacity, pixlayer::Blend blend)
+    {
+        if (layers.empty())
+            return;
+        pixlayer::Layer &l = layers[activeLayer];
+        l.visible = visible;
+        l.opacity = opacity;
+        l.blend = blend;
+        flatten();
+    }
+
+    // Keeps only the composite, as a single-layer frame
+    void mergeLayers()
+    {
+        if (layers.empty())
+            return;
+        flatten();
+        layers.clear();
+        activeLayer = 0;
+        flattener.clear();
+    }
+
+    // Call after changing pixels: invalidates the cached texture and the
+    // thumbnail (rebuilt once per UI frame by Canvas::refreshThumbnails)
+    void touch()
+    {
+        revision = newRevision();
+    }
+
+    static unsigned newRevision()
+    {
+        static std::atomic<unsigned> last{0}; // frames are touched from pool threads too
+        return ++last;
+    }
+
+    // Box-filtered mip chain of the pixels (pix_mip.h), brought up to date
+    // on the way out; empty for indexed frames, whose indices don't average
+    const pixmip::Chain &mipChain() const
+    {
+        if (mipRevision != revision)
+        {
+            if (indexed)
+                mips.clear();
+            else
+                mips.update(rgba);
+            mipRevision = revision;
+        }
+        return mips;
+    }
+
+    // CPU half of a thumbnail rebuild, run on pool threads while the UI
+    // thread waits (the mip chain copies the plane, which pix_tiles.h only
+    // allows off the UI thread while nothing writes). RGBA frames are
+    // area-averaged from the smallest mip level that still covers the
+    // thumbnail, so it is alpha-correct and doesn't alias; indexed frames
+    // stay point-sampled indices for the palette shader.
+    sf::Image buildThumbnail() const
+    {
+        if (indexed)
+            return thumbnailImage();
+        PIX_TRACE_SCOPE("buildThumbnail");
+        const pixmip::Chain &chain = mipChain();
+        unsigned level = chain.levelFor(THUMB_SIZE, THUMB_SIZE);
+        std::vector<u32> src, out((size_t)THUMB_SIZE * THUMB_SIZE);
+        if (level == 0)
+            src = rgba.read();
+        const u32 *px = level ? chain.level(level).px.data() : src.data();
+        unsigned w = level ? chain.level(level).width : width, h = level ? chain.level(level).height : height;
+        pixmip::resample(px, w, h, out.data(), THUMB_SIZE, THUMB_SIZE);
+        sf::Image img;
+        img.create(THUMB_SIZE, THUMB_SIZE, (const u8 *)out.data());
+        return img;
+    }
+
+    // Whether texture() would return without uploading anything
+    bool textureCurrent() const
+    {
+        return gpuRevision == revision && gpuStaleCount == 0 && gpuReady();
+    }
+
+    // Uploads pixels gathered by texturePixels() at revision rev, unless
+    // the frame has changed since
+    void uploadTexture(const std::vector<u32> &px, unsigned rev) const
+    {
+        if (rev != revision || px.size() != (size_t)width * height)
+            return;
+        pixprof::count(pixprof::COUNT_UPLOADS);
+        auto size = gpuTexture.getSize();
+        if (size.x != width || size.y != height)
+            gpuTexture.create(width, height);
+        gpuTexture.update((const u8 *)px.data());
+        gpuStale.assign((size_t)tileCols() * tileRows(), 0);
+        gpuStaleCount = 0;
+        keepUploaded();
+    }
+
+    // Persistent GPU copy of the frame. Tiles changed since the last call
+    // are found by pointer (pix_tiles.h) and marked stale; only the stale
+    // tiles overlapping `visible` (in frame pixels) are uploaded, one run
+    // per tile row, and the rest when they come into view.
+    const sf::Texture &texture() const { return texture(sf::IntRect(0, 0, (int)width, (int)height)); }
+    const sf::Texture &texture(const sf::IntRect &visible) const
+    {
+        if (gpuRevision != revision)
+            findStaleTiles();
+        if (gpuStaleCount)
+            uploadStaleTiles(visible);
+        return gpuTexture;
+    }
+
+private:
+    mutable sf::Texture gpuTexture;
+    mutable unsigned gpuRevision = ~0u;
+    mutable bool gpuIndexed = false;
+    // the planes as of the last scan; holding their tiles keeps the
+    // pointers compared against unique
+    mutable pixtile::Plane<u32> gpuRGBA;
+    mutable pixtile::Plane<u8> gpuIndices;
+    mutable std::vector<u8> gpuStale; // per tile: changed but not uploaded yet
+    mutable size_t gpuStaleCount = 0;
+    mutable std::vector<u32> uploadBuffer; // tiles gathered into rows for the upload
+    mutable pixmip::Chain mips;
+    mutable unsigned mipRevision = ~0u;
+    pixlayer::Flattener flattener;
+
+    unsigned tileCols() const { return (width + pixtile::TILE - 1) / pixtile::TILE; }
+    unsigned tileRows() const { return (height + pixtile::TILE - 1) / pixtile::TILE; }
+
+    bool gpuReady() const
+    {
+        auto size = gpuTexture.getSize();
+        return size.x == width && size.y == height && gpuIndexed == indexed &&
+               !(indexed ? gpuIndices.empty() : gpuRGBA.empty()) && gpuStale.size() == (size_t)tileCols() * tileRows();
+    }
+
+    void keepUploaded() const
+    {
+        gpuIndexed = indexed;
+        gpuRGBA = rgba;
+        gpuIndices = indices;
+        gpuRevision = revision;
+    }
+
+    void findStaleTiles() const
+    {
+        if (!gpuReady())
+        {
+            // new size or storage: every tile is stale
+            gpuTexture.create(width, height);
+            gpuStale.assign((size_t)tileCols() * tileRows(), 1);
+            gpuStaleCount = gpuStale.size();
+        }
+        else if (indexed)
+            markStale(indices, gpuIndices);
+        else
+            markStale(rgba, gpuRGBA);
+        keepUploaded();
+    }
+
+    template <class T>
+    void markStale(const pixtile::Plane<T> &now, const pixtile::Plane<T> &seen) const
+    {
+        for (unsigned ty = 0; ty < now.tileRows(); ++ty)
+            for (unsigned tx = 0; tx < now.tileCols(); ++tx)
+            {
+                u8 &stale = gpuStale[(size_t)ty * now.tileCols() + tx];
+                if (!stale && now.tile(tx, ty) != seen.tile(tx, ty))
+                {
+                    stale = 1;
+                    ++gpuStaleCount;
+                }
+            }
+    }
 
-        thumbnail.loadFromImage(thumbImg);
+    void uploadStaleTiles(const sf::IntRect &visible) const
+    {
+        using pixtile::TILE;
+        unsigned cols = tileCols(), rows = tileRows();
+        unsigned tx0 = (unsigned)std::max(0, visible.left) / TILE, ty0 = (unsigned)std::max(0, visible.top) / TILE;
+        unsigned tx1 = std::min(cols, (unsigned)std::max(0, visible.left + visible.width + (int)TILE - 1) / TILE);
+        unsigned ty1 = std::min(rows, (unsigned)std::max(0, visible.top + visible.height + (int)TILE - 1) / TILE);
+        pixprof::Scope scope(pixprof::PHASE_UPLOAD);
+        for (unsigned ty = ty0; ty < ty1; ++ty)
+            for (unsigned tx = tx0; tx < tx1;)
+            {
+                if (!gpuStale[(size_t)ty * cols + tx])
+                {
+                    ++tx;
+                    continue;
+                }
+                unsigned first = tx;
+                for (; tx < tx1 && gpuStale[(size_t)ty * cols + tx]; ++tx)
+                {
+                    gpuStale[(size_t)ty * cols + tx] = 0;
+                    --gpuStaleCount;
+                }
+                unsigned x0 = first * TILE, y0 = ty * TILE;
+                unsigned w = std::min(tx * TILE, width) - x0, h = std::min(y0 + TILE, height) - y0;
+                uploadBuffer.resize((size_t)w * h);
+                for (unsigned t = first; t < tx; ++t)
+                {
+                    unsigned tw = std::min(TILE, width - t * TILE);
+                    u32 *dst = uploadBuffer.data() + (t - first) * TILE;
+                    if (indexed)
+                    {
+                        const u8 *src = indices.tile(t, ty);
+                        for (unsigned y = 0; y < h; ++y)
+                            for (unsigned x = 0; x < tw; ++x)
+                                dst[(size_t)y * w + x] = 0xFFFFFF00u | src[y * TILE + x];
+                    }
+                    else
+                    {
+                        const u32 *src = rgba.tile(t, ty);
+                        for (unsigned y = 0; y < h; ++y)
+                            std::memcpy(dst + (size_t)y * w, src + y * TILE, tw * 4);
+                    }
+                }
+                gpuTexture.update((const u8 *)uploadBuffer.data(), w, h, x0, y0);
+                pixprof::count(pixprof::COUNT_UPLOADS);
+            }
     }
 };
 
+// Immutable view of the whole project for pool threads (saves, exports).
+// Taking one is O(frames): the pixels stay shared with the canvas until it
+// edits them.
+struct CanvasSnapshot
+{
+    unsigned width = 0, height = 0;
+    bool indexed = false;
+    std::vector<sf::Color> palette;
+    std::vector<FrameData> frames;
+    u64 id = 0; // snapshots are numbered in creation order
+};
+
 enum class Tool
 {
     Pencil,
@@ -121,35 +592,245 @@ public:
     Tool currentTool = Tool::Pencil;
     bool showGrid = true;
     bool onionSkin = false;
+    int onionPrev = 1, onionNext = 0; // ghost frames before / after the current one
+    float onionOpacity = 0.45f;       // opacity of the nearest ghost
+    float onionFalloff = 0.6f;        // opacity multiplier per extra frame of distance
+    bool onionTint = true;
+
+    // Export upscaling, applied by the PNG exporters (scale 1 = unscaled)
+    int exportScale = 1;
+    pixup::Mode exportMode = pixup::MODE_NEAREST;
+
+    // C header export (pix_cexport.h) for the embedded builds
+    pixcexport::Format headerFormat = pixcexport::FORMAT_RGB565;
+    bool headerRLE = false;
+
+    // Indexed-colour mode: frames store one byte per pixel into this shared
+    // palette (entry 0 is always transparent). paletteVersion is bumped on
+    // every palette change so renderers know to re-upload their lookup texture.
+    bool indexedMode = false;
+    std::vector<sf::Color> palette;
+    unsigned paletteVersion = 0;
 
     Canvas(unsigned w = 64, unsigned h = 64) : width(w), height(h)
     {
+        resetPalette();
         frames.emplace_back(w, h, "Frame 0");
     }
 
+    void resetPalette()
+    {
+        palette.clear();
+        palette.push_back(sf::Color::Transparent);
+        for (const Color &c : EightBitColors::Palette)
+            palette.push_back(sf::Color(c.r, c.g, c.b, c.a));
+        ++paletteVersion;
+    }
+
+    // Palette slot holding a colour, or -1 when there is none; with nearest,
+    // the closest slot instead. Never changes the palette.
+    int findPaletteIndex(const sf::Color &c, bool nearest = false) const
+    {
+        if (c.a == 0)
+            return 0;
+        for (size_t i = 1; i < palette.size(); ++i)
+            if (palette[i] == c)
+                return (int)i;
+        if (!nearest || palette.size() < 2)
+            return -1;
+        size_t best = 1;
+        int bestDist = 1 << 30;
+        for (size_t i = 1; i < palette.size(); ++i)
+        {
+            int dr = palette[i].r - c.r, dg = palette[i].g - c.g, db = palette[i].b - c.b, da = palette[i].a - c.a;
+            int d = dr * dr + dg * dg + db * db + da * da;
+            if (d < bestDist)
+            {
+                bestDist = d;
+                best = i;
+            }
+        }
+        return (int)best;
+    }
+
+    // Palette slot for a colour that is about to be stored: exact match,
+    // else a new entry while there is room, else the nearest existing colour
+    u8 addPaletteColor(const sf::Color &c)
+    {
+        int i = findPaletteIndex(c);
+        if (i >= 0)
+            return (u8)i;
+        if (palette.size() < 256)
+        {
+            palette.push_back(c);
+            ++paletteVersion;
+            return (u8)(palette.size() - 1);
+        }
+        return (u8)findPaletteIndex(c, true);
+    }
+
+    // Recolours every pixel using slot i across all frames at once
+    void setPaletteEntry(u8 i, const sf::Color &c)
+    {
+        if (i == 0 || i >= palette.size())
+            return;
+        palette[i] = c;
+        ++paletteVersion;
+    }
+
+    // Palette-swap preview: variants are alternative colours for the palette
+    // slots, shown in place of the real palette without touching any pixels.
+    // Colour cycling rotates the slots cycleFirst..cycleLast over time.
+    std::vector<std::vector<sf::Color>> paletteVariants;
+    int activeVariant = -1; // -1 = show the real palette
+    bool colorCycling = false;
+    int cycleFirst = 1, cycleLast = 16;
+    float cycleFps = 8.0f;
+    unsigned previewVersion = 0;
+
+    bool previewActive() const { return activeVariant >= 0 || colorCycling; }
+
+    void addPaletteVariant()
+    {
+        paletteVariants.push_back(displayPalette(0));
+        activeVariant = (int)paletteVariants.size() - 1;
+        ++previewVersion;
+    }
+
+    // Steps through none -> variant 0 -> variant 1 ... -> none
+    void nextPaletteVariant()
+    {
+        activeVariant = activeVariant + 1 < (int)paletteVariants.size() ? activeVariant + 1 : -1;
+        ++previewVersion;
+    }
+
+    // Edits a slot of whatever palette is on screen: the active variant if
+    // one is selected, else the real palette
+    void editPaletteSlot(u8 i, const sf::Color &c)
+    {
+        if (activeVariant < 0)
+        {
+            setPaletteEntry(i, c);
+            return;
+        }
+        auto &v = paletteVariants[activeVariant];
+        if (i == 0 || i >= palette.size())
+            return;
+        if (v.size() < palette.size())
+            v.insert(v.end(), palette.begin() + v.size(), palette.end());
+        v[i] = c;
+        ++previewVersion;
+    }
+
+    void setCycleRange(int first, int last)
+    {
+        cycleFirst = std::max(1, std::min(first, last));
+        cycleLast = std::min((int)palette.size() - 1, std::max(first, last));
+        ++previewVersion;
+    }
+
+    unsigned cycleStep(float seconds) const
+    {
+        return colorCycling ? (unsigned)(seconds * cycleFps) : 0;
+    }
+
+    // The palette as it should appear on screen for a given cycle step
+    std::vector<sf::Color> displayPalette(unsigned step) const
+    {
+        std::vector<sf::Color> out = palette;
+        if (activeVariant >= 0)
+        {
+            const auto &v = paletteVariants[activeVariant];
+            for (size_t i = 1; i < out.size() && i < v.size(); ++i)
+                out[i] = v[i];
+        }
+        int first = cycleFirst, last = std::min(cycleLast, (int)out.size() - 1);
+        if (colorCycling && last > first)
+        {
+            int len = last - first + 1;
+            std::vector<sf::Color> base(out.begin() + first, out.begin() + last + 1);
+            for (int i = 0; i < len; ++i)
+                out[first + (i + step) % len] = base[i];
+        }
+        return out;
+    }
+
+    void setIndexedMode(bool on)
+    {
+        if (on == indexedMode)
+            return;
+        indexedMode = on;
+        for (auto &f : frames)
+        {
+            if (on)
+                f.toIndexed([&](const sf::Color &c)
+                            { return addPaletteColor(c); });
+            else
+                f.toRGBA(palette);
+        }
+    }
+
+    // Rebuilds the thumbnails of frames changed since the last call: the
+    // downsampling (and with it the frames' mip chains) runs on the job
+    // pool, the uploads here on the UI thread
+    void refreshThumbnails()
+    {
+        std::vector<Frame *> stale;
+        for (auto &f : frames)
+            if (f.thumbRevision != f.revision)
+                stale.push_back(&f);
+        if (stale.empty())
+            return;
+
+        PIX_TRACE_SCOPE("refreshThumbnails");
+        pixprof::Scope scope(pixprof::PHASE_UPLOAD);
+        std::vector<sf::Image> images(stale.size());
+        pixjobs::pool().parallelFor(pixjobs::PRIORITY_INTERACTIVE, stale.size(), [&](size_t i)
+                                    { images[i] = stale[i]->buildThumbnail(); }, "thumbnail");
+        for (size_t i = 0; i < stale.size(); ++i)
+        {
+            stale[i]->thumbnail.loadFromImage(images[i]);
+            stale[i]->thumbRevision = stale[i]->revision;
+        }
+        pixprof::count(pixprof::COUNT_THUMBS, stale.size());
+        pixprof::count(pixprof::COUNT_UPLOADS, stale.size());
+    }
+
     void resizeCanvas(unsigned newWidth, unsigned newHeight)
     {
+        PIX_TRACE_SCOPE("resizeCanvas");
         width = newWidth;
         height = newHeight;
 
-        for (auto &frame : frames)
+        auto resizeFrame = [&](size_t fi)
         {
-            sf::Image newImage;
-            newImage.create(newWidth, newHeight, sf::Color(0, 0, 0, 0));
+            Frame &frame = frames[fi];
+            unsigned oldW = frame.width, oldH = frame.height;
+            frame.width = newWidth;
+            frame.height = newHeight;
 
-            // Copy existing pixels from old image to new image
-            auto oldSize = frame.image.getSize();
-            for (unsigned y = 0; y < std::min(oldSize.y, newHeight); ++y)
+            // Copy the overlapping rows of the old plane into the new one
+            auto resizePlane = [&](auto &plane)
             {
-                for (unsigned x = 0; x < std::min(oldSize.x, newWidth); ++x)
-                {
-                    newImage.setPixel(x, y, frame.image.getPixel(x, y));
-                }
-            }
-
-            frame.image = newImage;
-            frame.updateThumbnail();
-        }
+                auto old = plane.read();
+                decltype(old) px((size_t)newWidth * newHeight, 0);
+                for (unsigned y = 0; y < std::min(oldH, newHeight); ++y)
+                    std::copy_n(&old[(size_t)y * oldW], std::min(oldW, newWidth), &px[(size_t)y * newWidth]);
+                plane.create(newWidth, newHeight);
+                plane.write(px.data());
+            };
+            if (frame.indexed)
+                resizePlane(frame.indices);
+            else if (frame.layers.empty())
+                resizePlane(frame.rgba);
+            else
+                for (pixlayer::Layer &l : frame.layers)
+                    resizePlane(l.px);
+            frame.touch();
+            frame.flatten();
+        };
+        // frames are independent, so crop or pad them in parallel
+        pixjobs::pool().parallelFor(pixjobs::PRIORITY_INTERACTIVE, frames.size(), resizeFrame, "resizeFrame");
     }
 
     void newProject(unsigned w, unsigned h)
@@ -157,7 +838,7 @@ public:
         width = w;
         height = h;
         frames.clear();
-        frames.emplace_back(w, h, "Frame 0");
+        frames.emplace_back(w, h, "Frame 0", indexedMode);
         currentFrame = 0;
         zoom = 8.0f;
         pan = {0, 0};
@@ -165,7 +846,7 @@ public:
 
     void addFrame()
     {
-        frames.emplace_back(width, height, "Frame " + std::to_string(frames.size()));
+        frames.emplace_back(width, height, "Frame " + std::to_string(frames.size()), indexedMode);
         currentFrame = (int)frames.size() - 1;
     }
 
@@ -224,9 +905,31 @@ public:
             currentFrame = (currentFrame - 1 + frames.size()) % frames.size();
     }
 
+    // The frame pixels that land inside area (screen coordinates) at the
+    // current zoom and pan; empty when none do
+    sf::IntRect visibleRect(const sf::FloatRect &area) const
+    {
+        int x0 = std::max(0, (int)std::floor(-pan.x / zoom));
+        int y0 = std::max(0, (int)std::floor(-pan.y / zoom));
+        int x1 = std::min((int)width, (int)std::ceil((area.width - pan.x) / zoom));
+        int y1 = std::min((int)height, (int)std::ceil((area.height - pan.y) / zoom));
+        if (x1 <= x0 || y1 <= y0)
+            return sf::IntRect();
+        return sf::IntRect(x0, y0, x1 - x0, y1 - y0);
+    }
+
+    // One pass through the animation, in ms
+    u64 loopDuration() const
+    {
+        u64 total = 0;
+        for (const Frame &f : frames)
+            total += f.duration;
+        return total;
+    }
+
     sf::Image getCurrentFrameImage() const
     {
-        return frames[currentFrame].image;
+        return frames[currentFrame].expand(palette);
     }
 
     void setPixelAtCurrentFrame(int x, int y, const sf::Color &c)
@@ -234,15 +937,37 @@ public:
         if (x < 0 || y < 0 || x >= (int)width || y >= (int)height)
             return;
         Frame &f = frames[currentFrame];
-        f.setPixel(x, y, c);
+        if (f.indexed)
+            f.setIndex(x, y, addPaletteColor(c));
+        else
+        {
+            f.setPixel(x, y, c);
+            f.needsFlatten = !f.layers.empty();
+        }
+    }
+
+    // Brings the composites of frames painted this UI frame up to date, so
+    // a stroke is flattened once per UI frame rather than once per pixel
+    void flattenEdits()
+    {
+        for (Frame &f : frames)
+            if (f.needsFlatten)
+                f.flatten();
     }
 
     void floodFill(int sx, int sy, const sf::Color &newColor)
     {
+        PIX_TRACE_SCOPE("floodFill");
         if (sx < 0 || sy < 0 || sx >= (int)width || sy >= (int)height)
             return;
         Frame &f = frames[currentFrame];
-        sf::Color target = f.getPixel(sx, sy);
+        if (f.indexed)
+        {
+            floodFillIndexed(f, sx, sy, addPaletteColor(newColor));
+            return;
+        }
+        // fills the active layer's region, not the composite's
+        sf::Color target = f.getPaintPixel(sx, sy);
         if (target == newColor)
             return;
         std::vector<sf::Vector2i> stack;
@@ -254,7 +979,7 @@ public:
             int x = p.x, y = p.y;
             if (x < 0 || y < 0 || x >= (int)width || y >= (int)height)
                 continue;
-            if (f.getPixel(x, y) != target)
+            if (f.getPaintPixel(x, y) != target)
                 continue;
             f.setPixel(x, y, newColor);
             stack.emplace_back(x + 1, y);
@@ -262,96 +987,1590 @@ public:
             stack.emplace_back(x, y + 1);
             stack.emplace_back(x, y - 1);
         }
-        f.updateThumbnail();
+        f.touch();
+        f.flatten();
     }
 
-    // Save and load .pix custom format
-    bool saveToPix(const std::string &filename) const
+    void floodFillIndexed(Frame &f, int sx, int sy, u8 repl)
     {
-        std::ofstream ofs(filename, std::ios::binary);
-        if (!ofs)
-            return false;
-        ofs.write("PIX1", 4); // magic
-        auto write32 = [&](u32 v)
-        { ofs.write((char *)&v, 4); };
-        write32(width);
-        write32(height);
-        write32((u32)frames.size());
-        for (const Frame &f : frames)
+        u8 target = f.getIndex(sx, sy);
+        if (target == repl)
+            return;
+        std::vector<sf::Vector2i> stack;
+        stack.emplace_back(sx, sy);
+        while (!stack.empty())
         {
-            u32 nameLen = (u32)f.name.size();
-            write32(nameLen);
-            ofs.write(f.name.c_str(), nameLen);
-            // raw pixels RGBA
-            const sf::Image &img = f.image;
-            const sf::Uint8 *ptr = img.getPixelsPtr();
-            u32 total = width * height * 4;
-            ofs.write((char *)ptr, total);
+            auto p = stack.back();
+            stack.pop_back();
+            int x = p.x, y = p.y;
+            if (x < 0 || y < 0 || x >= (int)width || y >= (int)height)
+                continue;
+            if (f.indices.get(x, y) != target)
+                continue;
+            f.indices.set(x, y, repl);
+            stack.emplace_back(x + 1, y);
+            stack.emplace_back(x - 1, y);
+            stack.emplace_back(x, y + 1);
+            stack.emplace_back(x, y - 1);
         }
-        return true;
+        f.touch();
     }
 
-    bool loadFromPix(const std::string &filename)
+    // FNV-1a over the size, palette and every frame's pixels; equal hashes
+    // mean two sessions ended with the same project
+    uint64_t contentHash() const
     {
-        std::ifstream ifs(filename, std::ios::binary);
-        if (!ifs)
-            return false;
-        char magic[5] = {0};
-        ifs.read(magic, 4);
-        if (std::string(magic) != "PIX1")
-            return false;
-        auto read32 = [&]() -> u32
-        { u32 v; ifs.read((char*)&v,4); return v; };
-        u32 w = read32(), h = read32();
-        u32 fcount = read32();
-        frames.clear();
-        width = w;
-        height = h;
-        for (u32 fi = 0; fi < fcount; ++fi)
-        {
-            u32 nameLen = read32();
-            std::string name(nameLen, '\0');
-            ifs.read(&name[0], nameLen);
-            Frame f(width, height, name);
-            u32 total = width * height * 4;
-            std::vector<sf::Uint8> buf(total);
-            ifs.read((char *)buf.data(), total);
-            f.image.create(width, height, buf.data());
-            f.updateThumbnail();
-            frames.push_back(std::move(f));
+        uint64_t h = 1469598103934665603ull;
+        auto mix = [&](const void *data, size_t n)
+        {
+            const u8 *p = (const u8 *)data;
+            for (size_t i = 0; i < n; ++i)
+                h = (h ^ p[i]) * 1099511628211ull;
+        };
+        u32 header[3] = {width, height, indexedMode ? 1u : 0u};
+        mix(header, sizeof(header));
+        if (indexedMode)
+            for (const sf::Color &c : palette)
+            {
+                u8 rgba[4] = {c.r, c.g, c.b, c.a};
+                mix(rgba, 4);
+            }
+        for (const Frame &f : frames)
+        {
+            if (f.indexed)
+            {
+                std::vector<u8> px = f.indices.read();
+                mix(px.data(), px.size());
+            }
+            else
+            {
+                std::vector<u32> px = f.rgba.read();
+                mix(px.data(), px.size() * 4);
+            }
         }
-        currentFrame = 0;
-        return true;
+        return h;
     }
 
-    // Export current frame or all frames as PNGs
+    // Immutable view of every frame for pool threads; see CanvasSnapshot
+    std::shared_ptr<const CanvasSnapshot> snapshot() const
+    {
+        PIX_TRACE_SCOPE("snapshot");
+        static u64 taken = 0;
+        auto snap = std::make_shared<CanvasSnapshot>();
+        snap->width = width;
+        snap->height = height;
+        snap->indexed = indexedMode;
+        snap->palette = palette;
+        snap->id = ++taken;
+        snap->frames.reserve(frames.size());
+        for (const Frame &f : frames)
+            snap->frames.push_back(f.snapshot());
+        return snap;
+    }
+
+    // Replaces the whole project with a snapshot's content; layered frames
+    // are recomposited, as recovered journals only carry their layers
+    void restore(const CanvasSnapshot &snap)
+    {
+        width = snap.width;
+        height = snap.height;
+        indexedMode = snap.indexed;
+        palette = snap.palette;
+        ++paletteVersion;
+        frames.clear();
+        for (const FrameData &f : snap.frames)
+        {
+            frames.emplace_back(f);
+            frames.back().flatten();
+        }
+        currentFrame = 0;
+    }
+
+    // Save .pix custom format: PIXD, delta-coded RGBA or indexed frames
+    // with the palette stored once up front (pix_project.h)
+    static bool writePix(const CanvasSnapshot &d, const std::string &filename)
+    {
+        PIX_TRACE_SCOPE("writePix");
+        // Two saves of the same project may overlap on the pool; the newer
+        // snapshot always wins
+        static std::mutex lock;
+        static u64 written = 0;
+        std::lock_guard<std::mutex> g(lock);
+        if (d.id < written)
+            return true;
+        written = d.id;
+
+        // Written beside the project and renamed over it, so a crash
+        // mid-save never leaves a torn project file
+        std::string tmp = filename + ".tmp";
+        pixproj::Info info;
+        info.format = pixproj::FORMAT_PIXD;
+        info.width = d.width;
+        info.height = d.height;
+        info.frames = (u32)d.frames.size();
+        info.indexed = d.indexed;
+        info.timed = true;
+        for (const FrameData &f : d.frames)
+            info.layered = info.layered || !f.layers.empty();
+        if (d.indexed)
+            for (const sf::Color &c : d.palette)
+                info.palette.push_back(FrameData::pack(c));
+        pixproj::Writer out;
+        if (!out.open(tmp, info))
+            return false;
+        std::vector<pixproj::Layer> layers;
+        for (const FrameData &f : d.frames)
+        {
+            layers.resize(f.layers.size());
+            for (size_t i = 0; i < layers.size(); ++i)
+            {
+                layers[i].name = f.layers[i].name;
+                layers[i].attrs = f.layers[i].attrs();
+                layers[i].px.resize((size_t)d.width * d.height * 4);
+                f.layers[i].px.read((u32 *)layers[i].px.data());
+            }
+            out.add(f.bytes().data(), f.name, f.duration, layers);
+        }
+        if (!out.close())
+            return false;
+        if (std::rename(tmp.c_str(), filename.c_str()) != 0)
+        {
+            // Windows will not rename over an existing file
+            std::remove(filename.c_str());
+            return std::rename(tmp.c_str(), filename.c_str()) == 0;
+        }
+        return true;
+    }
+
+    bool saveToPix(const std::string &filename) const
+    {
+        PIX_TRACE_SCOPE("saveToPix");
+        return writePix(*snapshot(), filename);
+    }
+
+    // Loads any project file: the SFML build's PIX1 / PIXP / PIXD or the SDL
+    // build's PXL1 / PXL2 (pix_project.h). The canvas is left untouched
+    // unless the whole file loads.
+    bool loadFromPix(const std::string &filename)
+    {
+        PIX_TRACE_SCOPE("loadFromPix");
+        pixproj::Reader in;
+        std::vector<Frame> loaded;
+        if (in.open(filename))
+        {
+            const pixproj::Info &info = in.header();
+            std::vector<u32> scratch(info.pixels()); // one frame, reused
+            std::string name;
+            size_t keyFrame = 0;
+            loaded.reserve(info.frames);
+            while (!in.done() && in.next((u8 *)scratch.data(), name))
+            {
+                Frame f(info.width, info.height, name.empty() ? "Frame " + std::to_string(loaded.size()) : name, info.indexed);
+                if (in.frameDuration())
+                    f.setDuration(in.frameDuration());
+                if (info.indexed)
+                    f.indices.write((const u8 *)scratch.data());
+                else
+                    f.rgba.write(scratch.data());
+                // delta frames keep their keyframe's unchanged tiles shared
+                if (in.wasKey())
+                    keyFrame = loaded.size();
+                else if (info.indexed)
+                    f.indices.shareEqualTiles(loaded[keyFrame].indices);
+                else
+                    f.rgba.shareEqualTiles(loaded[keyFrame].rgba);
+                // the frame record holds the composite; layers replace it
+                for (size_t i = 0; i < in.layers().size() && !info.indexed; ++i)
+                {
+                    const pixproj::Layer &l = in.layers()[i];
+                    f.layers.emplace_back();
+                    f.layers.back().name = l.name;
+                    f.layers.back().setAttrs(l.attrs);
+                    f.layers.back().px.create(info.width, info.height);
+                    f.layers.back().px.write((const u32 *)l.px.data());
+                }
+                f.activeLayer = std::max(0, (int)f.layers.size() - 1);
+                f.touch();
+                f.flatten();
+                loaded.push_back(std::move(f));
+            }
+        }
+        if (!in.done() || loaded.empty())
+        {
+            std::cout << "Cannot load " << filename << ": " << in.error() << "\n";
+            return false;
+        }
+
+        const pixproj::Info &info = in.header();
+        width = info.width;
+        height = info.height;
+        indexedMode = info.indexed;
+        if (info.indexed)
+        {
+            palette.clear();
+            for (u32 c : info.palette)
+                palette.push_back(FrameData::unpack(c));
+            ++paletteVersion;
+        }
+        frames.swap(loaded);
+        currentFrame = 0;
+        return true;
+    }
+
+    // PNGs decoded into frames, not yet part of the canvas
+    struct PNGImport
+    {
+        unsigned width = 0, height = 0;
+        std::vector<FrameData> frames; // empty when the import failed
+        std::string error;
+    };
+
+    // Decodes PNGs into new RGBA frames (pix_import.h): a directory of PNGs
+    // becomes one frame per file, a single PNG is sliced as a spritesheet
+    // into cellW x cellH cells, or automatically when those are 0. Touches
+    // no canvas state, so it runs on any thread.
+    static void decodePNGImport(const std::string &path, unsigned cellW, unsigned cellH, PNGImport &out)
+    {
+        PIX_TRACE_SCOPE("decodePNGImport");
+        std::vector<std::string> files = piximport::filesAt(path);
+        std::vector<FrameData> &imported = out.frames;
+        unsigned &w = out.width, &h = out.height;
+        auto addFrame = [&](const std::string &name)
+        {
+            imported.emplace_back();
+            imported.back().name = name;
+            imported.back().width = w;
+            imported.back().height = h;
+            imported.back().rgba.create(w, h, 0);
+        };
+        if (files.size() > 1)
+        {
+            piximport::Sequence seq;
+            if (seq.open(files))
+            {
+                w = seq.width;
+                h = seq.height;
+                for (size_t i = 0; i < files.size(); ++i)
+                    addFrame(std::filesystem::path(files[i]).stem().string());
+                // tiles are not row-major, so each file decodes into a
+                // staging buffer that is copied into its frame's tiles and
+                // freed on the same worker; only files in flight hold one
+                std::vector<std::vector<u32>> staging(files.size());
+                auto target = [&](size_t i)
+                {
+                    staging[i].assign((size_t)w * h, 0);
+                    return staging[i].data();
+                };
+                auto filled = [&](size_t i)
+                {
+                    imported[i].rgba.write(staging[i].data());
+                    std::vector<u32>().swap(staging[i]);
+                };
+                if (!seq.decode(target, filled))
+                    imported.clear();
+            }
+            out.error = seq.error();
+        }
+        else if (files.size() == 1)
+        {
+            piximport::Sheet sheet;
+            if (sheet.load(files[0]))
+            {
+                std::vector<piximport::Rect> cells = sheet.slice(cellW, cellH);
+                piximport::Sheet::frameSize(cells, w, h);
+                for (size_t i = 0; i < cells.size(); ++i)
+                    addFrame("Frame " + std::to_string(i));
+                pixjobs::pool().parallelFor(pixjobs::PRIORITY_INTERACTIVE, cells.size(), [&](size_t i)
+                                            {
+                    std::vector<u32> px((size_t)w * h, 0);
+                    sheet.copy(cells[i], px.data(), w, h);
+                    imported[i].rgba.write(px.data()); }, "importCell");
+                out.error = cells.empty() ? "no frames found" : "";
+            }
+            else
+                out.error = sheet.error();
+        }
+        else
+            out.error = "no PNG files";
+    }
+
+    // Makes decoded frames the new project; the canvas is left untouched
+    // unless the import succeeded
+    bool adoptPNGImport(const std::string &path, PNGImport &im)
+    {
+        if (im.frames.empty())
+        {
+            std::cout << "Cannot import " << path << ": " << im.error << "\n";
+            return false;
+        }
+        std::vector<Frame> imported;
+        imported.reserve(im.frames.size());
+        for (FrameData &d : im.frames)
+        {
+            imported.emplace_back(d);
+            imported.back().touch();
+        }
+        width = im.width;
+        height = im.height;
+        indexedMode = false;
+        frames.swap(imported);
+        currentFrame = 0;
+        return true;
+    }
+
+    // Imports PNGs as a new RGBA project, decoding on the calling thread
+    bool importPNG(const std::string &path, unsigned cellW = 0, unsigned cellH = 0)
+    {
+        PNGImport im;
+        decodePNGImport(path, cellW, cellH, im);
+        return adoptPNGImport(path, im);
+    }
+
+    // As importPNG(), but decodes on the job pool; the frames replace the
+    // project from the job's completion, on the UI thread
+    pixjobs::Handle importPNGInBackground(const std::string &path, unsigned cellW = 0, unsigned cellH = 0)
+    {
+        auto im = std::make_shared<PNGImport>();
+        auto run = [im, path, cellW, cellH](pixjobs::Job &)
+        { decodePNGImport(path, cellW, cellH, *im); };
+        auto done = [this, im, path](bool completed)
+        {
+            if (completed && adoptPNGImport(path, *im))
+                std::cout << "Imported " << frames.size() << " frames\n";
+        };
+        return pixjobs::pool().submit(pixjobs::PRIORITY_INTERACTIVE, "importPNG", run, done);
+    }
+
+    // Streams an upscaled copy of img into a PNG row by row, so the full
+    // upscaled image is never held in memory. Modes that add no colours
+    // keep the source's palette and so still write an indexed PNG.
+    static bool writeUpscaledPNG(const sf::Image &img, const std::string &filename, int scale, pixup::Mode mode)
+    {
+        auto size = img.getSize();
+        std::vector<u32> px((size_t)size.x * size.y);
+        std::memcpy(px.data(), img.getPixelsPtr(), px.size() * 4);
+
+        pixpng::Palette colors;
+        if (pixup::preservesColors(mode))
+        {
+            colors.add(px.data(), px.size());
+            colors.finish();
+        }
+        pixpng::Writer png;
+        if (!png.open(filename, size.x * scale, size.y * scale, &colors))
+            return false;
+        bool ok = pixup::upscaleImage(mode, scale, px.data(), (int)size.x, (int)size.y, size.x,
+                                      [&](const u32 *row)
+                                      { return png.writePixels(row); });
+        return png.close() && ok;
+    }
+
+    static bool writeFramePNG(const sf::Image &img, const std::string &filename, int scale, pixup::Mode mode)
+    {
+        PIX_TRACE_SCOPE("exportFramePNG");
+        if (scale > 1)
+            return writeUpscaledPNG(img, filename, scale, mode);
+        auto size = img.getSize();
+        return pixpng::writeImage(filename, (const u32 *)img.getPixelsPtr(), size.x, size.y, size.x);
+    }
+
+    bool exportFramePNG(const Frame &f, const std::string &filename) const
+    {
+        return writeFramePNG(f.expand(palette), filename, exportScale, exportMode);
+    }
+
+    // Export current frame or all frames as PNGs
     bool exportCurrentFramePNG(const std::string &filename) const
     {
-        sf::Image img = frames[currentFrame].image;
-        return img.saveToFile(filename);
+        return exportFramePNG(frames[currentFrame], filename);
     }
-    bool exportAllFramesPNG(const std::string &basename) const
+
+    // Writes every frame into a C++ header of constexpr arrays in the
+    // header format. Indexed frames keep their palette slots in the INDEX
+    // formats.
+    bool exportHeader(const std::string &filename) const
     {
+        PIX_TRACE_SCOPE("exportHeader");
+        pixcexport::Options opt;
+        opt.format = headerFormat;
+        opt.rle = headerRLE;
+        for (const sf::Color &c : palette)
+            opt.palette.push_back(FrameData::pack(c));
+        std::vector<std::vector<u32>> rgba(frames.size());
+        std::vector<std::vector<u8>> indices(frames.size());
+        std::vector<pixcexport::Frame> out(frames.size());
         for (size_t i = 0; i < frames.size(); ++i)
         {
-            std::ostringstream oss;
-            oss << basename << "_" << i << ".png";
-            if (!frames[i].image.saveToFile(oss.str()))
-                return false;
+            out[i].name = frames[i].name;
+            if (frames[i].indexed)
+            {
+                indices[i] = frames[i].indices.read();
+                out[i].indices = indices[i].data();
+            }
+            else
+            {
+                rgba[i] = frames[i].rgba.read();
+                out[i].rgba = rgba[i].data();
+            }
+        }
+        pixcexport::Writer writer;
+        if (!writer.write(filename, width, height, out, opt))
+        {
+            std::cout << "Cannot export " << filename << ": " << writer.error() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Snapshots the frames and encodes them on the job pool, one file per
+    // frame in parallel. The handle reports progress and can cancel the
+    // frames not written yet.
+    pixjobs::Handle exportAllFramesPNG(const std::string &basename) const
+    {
+        PIX_TRACE_SCOPE("exportAllFramesPNG");
+        auto snap = snapshot();
+        auto failed = std::make_shared<std::atomic<size_t>>(0);
+        int scale = exportScale;
+        pixup::Mode mode = exportMode;
+
+        auto run = [snap, failed, basename, scale, mode](pixjobs::Job &job)
+        {
+            std::atomic<size_t> done{0};
+            pixjobs::pool().parallelFor(pixjobs::PRIORITY_BACKGROUND, snap->frames.size(), [&](size_t i)
+                                        {
+                if (job.isCancelled())
+                    return;
+                std::ostringstream oss;
+                oss << basename << "_" << i << ".png";
+                if (!writeFramePNG(snap->frames[i].expand(snap->palette), oss.str(), scale, mode))
+                    ++*failed;
+                job.setProgress(++done, snap->frames.size()); }, "exportFrame");
+        };
+        auto done = [snap, failed, basename](bool completed)
+        {
+            if (!completed)
+                std::cout << "Export cancelled\n";
+            else if (*failed)
+                std::cout << "Export failed for " << *failed << " of " << snap->frames.size() << " frames\n";
+            else
+                std::cout << "Exported " << snap->frames.size() << " frames to " << basename << "_*.png\n";
+        };
+        return pixjobs::pool().submit(pixjobs::PRIORITY_BACKGROUND, "exportAllFramesPNG", run, done);
+    }
+
+    // Streams the animation as uncompressed video (pix_video.h) at
+    // videoFps, upscaled like the PNG exports, to a file or "-" for stdout.
+    // Frames keep their playback durations, from frame 0, and the whole
+    // animation plays `loops` times. Each animation frame is expanded and
+    // converted once and repeated while it stays on screen, so memory is
+    // one frame.
+    pixjobs::Handle exportVideo(const std::string &path, pixvideo::Format format, unsigned videoFps, unsigned loops = 1) const
+    {
+        PIX_TRACE_SCOPE("exportVideo");
+        auto snap = snapshot();
+        auto failed = std::make_shared<std::atomic<bool>>(false);
+        int scale = std::max(1, std::min(pixup::MAX_SCALE, exportScale));
+        pixup::Mode mode = exportMode;
+        videoFps = std::max(1u, videoFps);
+        // Times are kept in units of 1/videoFps ms, where every frame
+        // boundary and video frame (video frame t starts at 1000 t) lands
+        // on an integer, so the frame choice is exact however long the
+        // video runs
+        std::vector<u64> ends; // end of each frame
+        u64 loop = 0;
+        for (const FrameData &f : snap->frames)
+            ends.push_back(loop += (u64)f.duration * videoFps);
+        size_t total = std::max<u64>(1, (std::max(1u, loops) * loop + 500) / 1000);
+
+        auto run = [snap, failed, path, format, videoFps, scale, mode, ends, total](pixjobs::Job &job)
+        {
+            unsigned w = snap->width, h = snap->height;
+            pixvideo::Writer video;
+            // a failed export cancels itself, so the handle tells callers
+            auto fail = [&]()
+            {
+                *failed = true;
+                job.cancel();
+            };
+            if (!video.open(path, w * scale, h * scale, videoFps, format))
+                return fail();
+            u32 lut[256];
+            for (int i = 0; i < 256; ++i)
+                lut[i] = i < (int)snap->palette.size() ? FrameData::pack(snap->palette[i]) : 0;
+            std::vector<u32> px((size_t)w * h);
+            std::vector<u8> idx;
+            size_t shown = SIZE_MAX;
+            for (size_t t = 0; t < total && !job.isCancelled(); ++t)
+            {
+                u64 at = (u64)t * 1000 % ends.back();
+                size_t k = std::upper_bound(ends.begin(), ends.end(), at) - ends.begin();
+                if (k != shown)
+                {
+                    const FrameData &f = snap->frames[k];
+                    if (f.indexed)
+                    {
+                        idx.resize(px.size());
+                        f.indices.read(idx.data());
+                        for (size_t i = 0; i < px.size(); ++i)
+                            px[i] = lut[idx[i]];
+                    }
+                    else
+                        f.rgba.read(px.data());
+                    u32 y = 0;
+                    pixup::upscaleImage(mode, scale, px.data(), (int)w, (int)h, w, [&](const u32 *row)
+                                        {
+                        video.setRow(y++, row);
+                        return true; });
+                    shown = k;
+                }
+                if (!video.writeFrame())
+                    return fail();
+                job.setProgress(t + 1, total);
+            }
+            if (!video.close())
+                fail();
+        };
+        auto done = [failed, path, total, videoFps](bool completed)
+        {
+            if (*failed)
+                std::cout << "Video export to " << path << " failed\n";
+            else if (!completed)
+                std::cout << "Video export cancelled\n";
+            else
+                std::cout << "Exported " << total << " video frames (" << total / (double)videoFps << "s) to "
+                          << (path == "-" ? "stdout" : path) << "\n";
+        };
+        return pixjobs::pool().submit(pixjobs::PRIORITY_BACKGROUND, "exportVideo", run, done);
+    }
+};
+
+// Render window that counts draw calls for the profiler HUD. draw() only
+// hides sf::RenderTarget's, so screen drawing takes an EditorWindow&.
+class EditorWindow : public sf::RenderWindow
+{
+public:
+    using sf::RenderWindow::RenderWindow;
+
+    void draw(const sf::Drawable &drawable, const sf::RenderStates &states = sf::RenderStates::Default)
+    {
+        pixprof::count(pixprof::COUNT_DRAWS);
+        sf::RenderWindow::draw(drawable, states);
+    }
+
+    void draw(const sf::Vertex *vertices, std::size_t count, sf::PrimitiveType type, const sf::RenderStates &states = sf::RenderStates::Default)
+    {
+        pixprof::count(pixprof::COUNT_DRAWS);
+        sf::RenderWindow::draw(vertices, count, type, states);
+    }
+};
+
+// Grid lines over the visible part of the canvas: one line per visible
+// row and column boundary, clipped to the visible rectangle, and rebuilt
+// only when the view moves, so neither the vertex count nor the rebuilds
+// grow with the canvas size.
+class GridOverlay
+{
+public:
+    void draw(EditorWindow &window, sf::Vector2f origin, float zoom, const sf::IntRect &visible)
+    {
+        if (origin != shownOrigin || zoom != shownZoom || visible != shownVisible)
+        {
+            rebuild(origin, zoom, visible);
+            shownOrigin = origin;
+            shownZoom = zoom;
+            shownVisible = visible;
+        }
+        window.draw(lines);
+    }
+
+private:
+    sf::VertexArray lines{sf::Lines};
+    sf::Vector2f shownOrigin;
+    float shownZoom = 0;
+    sf::IntRect shownVisible;
+
+    void rebuild(sf::Vector2f origin, float zoom, const sf::IntRect &visible)
+    {
+        sf::Color c(EightBitColors::DarkGray.r, EightBitColors::DarkGray.g, EightBitColors::DarkGray.b);
+        float left = origin.x + visible.left * zoom, right = origin.x + (visible.left + visible.width) * zoom;
+        float top = origin.y + visible.top * zoom, bottom = origin.y + (visible.top + visible.height) * zoom;
+        lines.clear();
+        for (int x = visible.left; x <= visible.left + visible.width; ++x)
+        {
+            float sx = origin.x + x * zoom;
+            lines.append(sf::Vertex({sx, top}, c));
+            lines.append(sf::Vertex({sx, bottom}, c));
+        }
+        for (int y = visible.top; y <= visible.top + visible.height; ++y)
+        {
+            float sy = origin.y + y * zoom;
+            lines.append(sf::Vertex({left, sy}, c));
+            lines.append(sf::Vertex({right, sy}, c));
+        }
+    }
+};
+
+// GPU copy of one mip level of the frame on screen, for zoom below 1x and
+// scrubbing proxies. Re-uploaded only when the frame's pixels or the level
+// change; a level is a quarter the size of the one above, so this is cheap.
+class MipView
+{
+public:
+    static const unsigned PROXY_SIZE = 128; // scrubbing shows the deepest level at least this big
+    static constexpr float MIN_ZOOM = 1.f / 16;
+
+    const sf::Texture &texture(const Frame &f, unsigned level)
+    {
+        if (f.revision != revision || level != shownLevel)
+        {
+            pixprof::Scope scope(pixprof::PHASE_UPLOAD);
+            pixprof::count(pixprof::COUNT_UPLOADS);
+            const pixmip::Level &lv = f.mipChain().level(level);
+            if (tex.getSize().x != lv.width || tex.getSize().y != lv.height)
+                tex.create(lv.width, lv.height);
+            tex.update((const u8 *)lv.px.data());
+            revision = f.revision;
+            shownLevel = level;
+        }
+        return tex;
+    }
+
+private:
+    sf::Texture tex;
+    unsigned revision = ~0u, shownLevel = 0;
+};
+
+// Animation preview clock. Time accumulates independently of the render
+// rate and each frame stays up for exactly its duration: leftover time
+// carries into the next frame and a long UI frame skips as many animation
+// frames as it covered, so the preview keeps in-game timing at any refresh
+// rate and never drifts. Skipped frames are counted as dropped.
+//
+// While playing, a prefetch ring keeps the next RING frames' textures
+// uploaded before they are due: each slot gathers one frame's pixels from
+// a snapshot on the job pool into its own reused buffer, and the UI thread
+// only uploads finished buffers, so frame changes cost no tile gathering.
+// A slot is matched to its frame by index and revision (unique per pixel
+// content), so edits, reordering and deletes simply waste the slot.
+class Playback
+{
+public:
+    static const int RING = 6;
+
+    bool playing = false;
+    u64 dropped = 0; // frames skipped since playback started
+
+    void toggle()
+    {
+        playing = !playing;
+        elapsed = 0;
+        dropped = 0;
+    }
+
+    // Advances the canvas by dt seconds of playback
+    void update(double dt, Canvas &canvas)
+    {
+        if (!playing || canvas.frames.size() < 2)
+            return;
+        elapsed += dt * 1000.0;
+        // a whole loop ends where it started, so stalls cost no iterations
+        u64 skipped = 0;
+        double loop = (double)canvas.loopDuration();
+        if (elapsed >= loop)
+        {
+            skipped = (u64)(elapsed / loop) * canvas.frames.size();
+            elapsed = std::fmod(elapsed, loop);
+        }
+        u64 advanced = 0;
+        while (elapsed >= canvas.frames[canvas.currentFrame].duration)
+        {
+            elapsed -= canvas.frames[canvas.currentFrame].duration;
+            canvas.nextFrame();
+            ++advanced;
+        }
+        // only the frame landed on is shown
+        skipped += advanced > 1 ? advanced - 1 : 0;
+        if (skipped)
+        {
+            dropped += skipped;
+            pixprof::count(pixprof::COUNT_DROPPED, skipped);
+        }
+    }
+
+    // Uploads finished slots and refills free ones with the frames coming
+    // up next. Call once per UI frame, after update().
+    void prefetch(const Canvas &canvas)
+    {
+        PIX_TRACE_SCOPE("prefetch");
+        size_t n = canvas.frames.size();
+        for (Slot &s : slots)
+        {
+            if (!s.job || !s.job->finished)
+                continue;
+            if (!s.job->isCancelled() && s.frame < n)
+            {
+                pixprof::Scope scope(pixprof::PHASE_UPLOAD);
+                canvas.frames[s.frame].uploadTexture(*s.pixels, s.revision);
+            }
+            s.job.reset();
+        }
+        if (!playing || n < 2)
+            return;
+
+        size_t ahead = std::min<size_t>(RING, n - 1);
+        for (size_t d = 1; d <= ahead; ++d)
+        {
+            size_t i = (canvas.currentFrame + d) % n;
+            const Frame &f = canvas.frames[i];
+            if (f.textureCurrent() || pending(i, f.revision))
+                continue;
+            Slot *free = nullptr;
+            for (Slot &s : slots)
+                if (!s.job)
+                    free = &s;
+            if (!free)
+                return;
+            free->frame = i;
+            free->revision = f.revision;
+            auto data = std::make_shared<FrameData>(f.snapshot());
+            auto pixels = free->pixels;
+            free->job = pixjobs::pool().submit(pixjobs::PRIORITY_INTERACTIVE, "prefetchFrame", [data, pixels](pixjobs::Job &)
+                                               { data->texturePixels(*pixels); });
+        }
+    }
+
+private:
+    struct Slot
+    {
+        size_t frame = 0;
+        unsigned revision = 0;
+        std::shared_ptr<std::vector<u32>> pixels = std::make_shared<std::vector<u32>>();
+        pixjobs::Handle job; // set while the slot is in use
+    };
+
+    double elapsed = 0; // ms into the current frame
+    Slot slots[RING];
+
+    bool pending(size_t frame, unsigned revision) const
+    {
+        for (const Slot &s : slots)
+            if (s.job && s.frame == frame && s.revision == revision)
+                return true;
+        return false;
+    }
+};
+
+// Crash-safe autosave. Every few seconds the canvas is snapshotted and the
+// tiles changed since the previous flush are appended to <project>.journal
+// on the job pool. A tile changed exactly when its pointer differs from the
+// one in the previous flush's snapshot (pix_tiles.h), so finding them costs
+// nothing per pixel. Once the project has been saved, compaction (every
+// minute, on Ctrl+S and on exit) folds the journal into the project file
+// and restarts it; before that it rewrites the journal as one full flush,
+// leaving an older project.pix alone. A journal left behind by a crash is
+// replayed on startup.
+//
+// Journal: "PIXJ", u32 version, u32 based (1 = applies on top of the project
+// file, 0 = complete on its own), then records of u32 type, u32 size,
+// payload, u32 CRC-32 of type and payload. Each flush ends in a COMMIT
+// record; recovery applies whole flushes only and stops at the first
+// damaged record.
+class Autosave
+{
+public:
+    const float FLUSH_SECONDS = 5.f;
+    const float COMPACT_SECONDS = 60.f;
+
+    bool enabled = true; // off while replaying, so replays stay deterministic
+
+    explicit Autosave(const std::string &project) : st(std::make_shared<State>())
+    {
+        st->projectPath = project;
+        st->journalPath = project + ".journal";
+    }
+
+    // Startup: replays a journal left behind by a crash into canvas
+    bool recover(Canvas &canvas)
+    {
+        PIX_TRACE_SCOPE("recoverJournal");
+        std::ifstream ifs(st->journalPath, std::ios::binary);
+        if (!ifs)
+            return false;
+        char magic[5] = {0};
+        u32 head[2] = {0, 0};
+        ifs.read(magic, 4);
+        ifs.read((char *)head, sizeof(head));
+        if (!ifs || std::string(magic) != "PIXJ" || head[0] != VERSION)
+        {
+            std::cout << "Ignoring unreadable " << st->journalPath << "\n";
+            return false;
+        }
+        if (head[1] && !canvas.loadFromPix(st->projectPath))
+        {
+            std::cout << "Cannot recover " << st->journalPath << ": " << st->projectPath << " is missing\n";
+            return false;
+        }
+
+        CanvasSnapshot state = *canvas.snapshot(), pending = state;
+        size_t flushes = 0;
+        for (;;)
+        {
+            u32 rec[2];
+            if (!ifs.read((char *)rec, sizeof(rec)) || rec[1] > (1u << 28))
+                break;
+            std::string payload(rec[1], '\0');
+            u32 crc = 0;
+            if (!ifs.read(&payload[0], rec[1]) || !ifs.read((char *)&crc, 4))
+                break;
+            if (crc != checksum(rec[0], payload) || !apply(pending, rec[0], payload))
+                break;
+            if (rec[0] == REC_COMMIT)
+            {
+                state = pending;
+                ++flushes;
+            }
+        }
+        ifs.close();
+        if (flushes == 0)
+            return false;
+        canvas.restore(state);
+
+        // A based journal means the project file is this project's, so the
+        // recovered work goes straight into it; otherwise it stays in a
+        // fresh journal until the first Ctrl+S
+        st->ownsProject = head[1] != 0;
+        if (st->ownsProject)
+            compactNow(*st, canvas.snapshot(), false);
+        else
+            appendNow(*st, canvas.snapshot());
+        std::cout << "Recovered " << flushes << " autosaves from " << st->journalPath
+                  << (st->ownsProject ? "\n" : " (unsaved project: Ctrl+S keeps it)\n");
+        return true;
+    }
+
+    // UI thread, once per frame
+    void tick(const Canvas &canvas, float dt)
+    {
+        if (!enabled)
+            return;
+        sinceFlush += dt;
+        sinceCompact += dt;
+        if (sinceFlush < FLUSH_SECONDS || (flushJob && !flushJob->finished))
+            return;
+        sinceFlush = 0;
+        auto snap = canvas.snapshot();
+        std::shared_ptr<State> state = st;
+        if (sinceCompact >= COMPACT_SECONDS)
+        {
+            sinceCompact = 0;
+            flushJob = pixjobs::pool().submit(pixjobs::PRIORITY_BACKGROUND, "compactJournal", [state, snap](pixjobs::Job &)
+                                              { compactNow(*state, snap, false); });
+        }
+        else
+            flushJob = pixjobs::pool().submit(pixjobs::PRIORITY_BACKGROUND, "flushJournal", [state, snap](pixjobs::Job &)
+                                              { appendNow(*state, snap); });
+    }
+
+    // Ctrl+S: writes the project file on the job pool and restarts the
+    // journal on top of it
+    pixjobs::Handle save(const Canvas &canvas)
+    {
+        auto snap = canvas.snapshot();
+        std::shared_ptr<State> state = st;
+        auto ok = std::make_shared<bool>(false);
+        sinceCompact = 0;
+        saveJob = pixjobs::pool().submit(
+            pixjobs::PRIORITY_BACKGROUND, "saveToPix", [state, snap, ok](pixjobs::Job &)
+            { *ok = compactNow(*state, snap, true); },
+            [state, ok](bool)
+            { std::cout << (*ok ? "Saved " : "Failed to save ") << state->projectPath << "\n"; });
+        return saveJob;
+    }
+
+    // Clean exit: folds the last changes into a saved project and removes
+    // the journal, so the next start has nothing to recover. Work that was
+    // never saved is dropped, as it was before autosave.
+    void shutdown(const Canvas &canvas)
+    {
+        for (auto &job : {flushJob, saveJob})
+            if (job)
+                pixjobs::pool().wait(job);
+        if (!enabled)
+            return;
+        if (st->ownsProject && !compactNow(*st, canvas.snapshot(), false))
+            return; // keep the journal, it still has the work
+        std::lock_guard<std::mutex> g(st->lock);
+        st->journal.close();
+        std::remove(st->journalPath.c_str());
+    }
+
+private:
+    static const u32 VERSION = 1;
+    enum Record
+    {
+        REC_CANVAS = 1, // size, format, palette, frame names, durations, layer stacks
+        REC_TILE,       // frame, tile x, tile y, TILE * TILE pixels
+        REC_COMMIT,     // end of one flush
+        REC_LAYER_TILE  // frame, layer, tile x, tile y, TILE * TILE RGBA pixels
+    };
+
+    // Shared with the pool jobs, which may still be queued after a call returns
+    struct State
+    {
+        std::mutex lock; // one journal writer at a time
+        std::string projectPath, journalPath;
+        std::ofstream journal;
+        std::shared_ptr<const CanvasSnapshot> last;   // state the journal reproduces
+        std::shared_ptr<const CanvasSnapshot> folded; // state last written to the project file
+        bool ownsProject = false;                     // project file saved or recovered this session
+        size_t flushes = 0;                           // in the journal since it was restarted
+    };
+
+    std::shared_ptr<State> st;
+    float sinceFlush = 0, sinceCompact = 0;
+    pixjobs::Handle flushJob, saveJob;
+
+    static void put32(std::string &out, u32 v) { out.append((const char *)&v, 4); }
+
+    static u32 checksum(u32 type, const std::string &payload)
+    {
+        u32 crc = pixpng::crc32(0, (const u8 *)&type, 4);
+        return pixpng::crc32(crc, (const u8 *)payload.data(), payload.size());
+    }
+
+    static void putRecord(std::string &out, u32 type, const std::string &payload)
+    {
+        put32(out, type);
+        put32(out, (u32)payload.size());
+        out += payload;
+        put32(out, checksum(type, payload));
+    }
+
+    static std::string canvasRecord(const CanvasSnapshot &snap)
+    {
+        std::string out;
+        put32(out, snap.width);
+        put32(out, snap.height);
+        put32(out, snap.indexed);
+        put32(out, (u32)snap.palette.size());
+        for (const sf::Color &c : snap.palette)
+            put32(out, FrameData::pack(c));
+        put32(out, (u32)snap.frames.size());
+        for (const FrameData &f : snap.frames)
+        {
+            put32(out, (u32)f.name.size());
+            out += f.name;
+        }
+        // durations trail the names, so journals without them still apply,
+        // and the layer stacks trail those
+        for (const FrameData &f : snap.frames)
+            put32(out, f.duration);
+        for (const FrameData &f : snap.frames)
+        {
+            put32(out, (u32)f.layers.size());
+            for (const pixlayer::Layer &l : f.layers)
+            {
+                put32(out, l.attrs());
+                put32(out, (u32)l.name.size());
+                out += l.name;
+            }
+        }
+        return out;
+    }
+
+    // Appends one TILE record (LAYER_TILE with a layer) per tile of plane
+    // not shared with prev (every tile when there is no comparable previous
+    // frame)
+    template <class T>
+    static size_t diffTiles(std::string &out, u32 frame, const pixtile::Plane<T> &plane, const pixtile::Plane<T> *prev, int layer = -1)
+    {
+        size_t n = 0;
+        for (unsigned ty = 0; ty < plane.tileRows(); ++ty)
+            for (unsigned tx = 0; tx < plane.tileCols(); ++tx)
+            {
+                const T *px = plane.tile(tx, ty);
+                if (prev && prev->tile(tx, ty) == px)
+                    continue;
+                std::string payload;
+                put32(payload, frame);
+                if (layer >= 0)
+                    put32(payload, (u32)layer);
+                put32(payload, tx);
+                put32(payload, ty);
+                payload.append((const char *)px, pixtile::TILE * pixtile::TILE * sizeof(T));
+                putRecord(out, layer >= 0 ? REC_LAYER_TILE : REC_TILE, payload);
+                ++n;
+            }
+        return n;
+    }
+
+    static bool sameShape(const FrameData &a, const FrameData &b)
+    {
+        return a.width == b.width && a.height == b.height && a.indexed == b.indexed;
+    }
+
+    // Records taking base to snap, ending in a COMMIT; returns how many of
+    // them carry a change (0 when snap matches base)
+    static size_t diff(std::string &out, const CanvasSnapshot *base, const CanvasSnapshot &snap)
+    {
+        std::string canvas = canvasRecord(snap);
+        size_t changes = !base || canvasRecord(*base) != canvas;
+        putRecord(out, REC_CANVAS, canvas);
+        for (u32 i = 0; i < snap.frames.size(); ++i)
+        {
+            const FrameData &f = snap.frames[i];
+            const FrameData *prev = base && i < base->frames.size() && sameShape(base->frames[i], f) ? &base->frames[i] : nullptr;
+            if (f.indexed)
+                changes += diffTiles(out, i, f.indices, prev ? &prev->indices : nullptr);
+            else if (f.layers.empty())
+            {
+                // a layered frame's composite never reached the journal
+                bool comparable = prev && prev->layers.empty();
+                changes += diffTiles(out, i, f.rgba, comparable ? &prev->rgba : nullptr);
+            }
+            else
+            {
+                // the composite is rebuilt on recovery, so only layers are logged
+                for (size_t j = 0; j < f.layers.size(); ++j)
+                {
+                    const pixtile::Plane<u32> *was = prev && j < prev->layers.size() ? &prev->layers[j].px : nullptr;
+                    changes += diffTiles(out, i, f.layers[j].px, was, (int)j);
+                }
+            }
+        }
+        std::string id;
+        put32(id, (u32)snap.id);
+        putRecord(out, REC_COMMIT, id);
+        return changes;
+    }
+
+    // Replaces the journal with a header plus first (written beside it and
+    // renamed over it), then keeps it open for appending
+    static bool restartJournal(State &s, bool based, const std::string &first = std::string())
+    {
+        s.journal.close();
+        std::string tmp = s.journalPath + ".tmp";
+        {
+            std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+            u32 head[2] = {VERSION, based ? 1u : 0u};
+            ofs.write("PIXJ", 4);
+            ofs.write((const char *)head, sizeof(head));
+            ofs.write(first.data(), first.size());
+            if (!ofs)
+                return false;
+        }
+        if (std::rename(tmp.c_str(), s.journalPath.c_str()) != 0)
+        {
+            std::remove(s.journalPath.c_str());
+            if (std::rename(tmp.c_str(), s.journalPath.c_str()) != 0)
+                return false;
+        }
+        s.journal.open(s.journalPath, std::ios::binary | std::ios::app);
+        s.flushes = first.empty() ? 0 : 1;
+        return (bool)s.journal;
+    }
+
+    static bool appendNow(State &s, const std::shared_ptr<const CanvasSnapshot> &snap)
+    {
+        PIX_TRACE_SCOPE("appendJournal");
+        std::lock_guard<std::mutex> g(s.lock);
+        if (s.last && s.last->id >= snap->id)
+            return true; // a newer state is already on disk
+
+        std::string flush;
+        if (diff(flush, s.last.get(), *snap) == 0)
+            return true;
+        if (!s.journal.is_open())
+        {
+            // first flush of the session; s.last is empty, so flush is complete
+            if (!restartJournal(s, false, flush))
+                return false;
+        }
+        else
+        {
+            s.journal.write(flush.data(), flush.size());
+            s.journal.flush();
+            ++s.flushes;
+        }
+        s.last = snap;
+        return (bool)s.journal;
+    }
+
+    // Folds everything up to snap into the project file (when it is ours)
+    // or into a one-flush journal, then restarts the journal on top of it
+    static bool compactNow(State &s, std::shared_ptr<const CanvasSnapshot> snap, bool save)
+    {
+        PIX_TRACE_SCOPE("compactJournal");
+        std::lock_guard<std::mutex> g(s.lock);
+        if (s.last && s.last->id > snap->id)
+            snap = s.last; // never fold an older state over a newer flush
+        std::string scratch;
+        if (save)
+            s.ownsProject = true;
+        else if (!s.ownsProject)
+        {
+            if (s.flushes <= 1 && (!s.last || diff(scratch, s.last.get(), *snap) == 0))
+                return true; // already as short as it gets
+            scratch.clear();
+            diff(scratch, nullptr, *snap);
+            s.last = snap;
+            return restartJournal(s, false, scratch);
+        }
+        else if (s.folded && diff(scratch, s.folded.get(), *snap) == 0)
+            return true;
+
+        if (!Canvas::writePix(*snap, s.projectPath))
+            return false;
+        s.last = s.folded = snap;
+        return restartJournal(s, true);
+    }
+
+    // Applies one journal record to the state being recovered
+    static bool apply(CanvasSnapshot &snap, u32 type, const std::string &payload)
+    {
+        if (type == REC_COMMIT)
+            return true;
+        if (type == REC_TILE)
+        {
+            u32 hdr[3];
+            if (payload.size() < sizeof(hdr))
+                return false;
+            std::memcpy(hdr, payload.data(), sizeof(hdr));
+            if (hdr[0] >= snap.frames.size())
+                return false;
+            FrameData &f = snap.frames[hdr[0]];
+            size_t bytes = pixtile::TILE * pixtile::TILE * (f.indexed ? 1 : 4);
+            if (payload.size() != sizeof(hdr) + bytes)
+                return false;
+            if (f.indexed ? hdr[1] >= f.indices.tileCols() || hdr[2] >= f.indices.tileRows()
+                          : hdr[1] >= f.rgba.tileCols() || hdr[2] >= f.rgba.tileRows())
+                return false;
+            if (f.indexed)
+                f.indices.setTile(hdr[1], hdr[2], (const u8 *)payload.data() + sizeof(hdr));
+            else
+            {
+                std::vector<u32> px(bytes / 4);
+                std::memcpy(px.data(), payload.data() + sizeof(hdr), bytes);
+                f.rgba.setTile(hdr[1], hdr[2], px.data());
+            }
+            return true;
+        }
+        if (type == REC_LAYER_TILE)
+        {
+            u32 hdr[4];
+            size_t bytes = pixtile::TILE * pixtile::TILE * 4;
+            if (payload.size() != sizeof(hdr) + bytes)
+                return false;
+            std::memcpy(hdr, payload.data(), sizeof(hdr));
+            if (hdr[0] >= snap.frames.size() || hdr[1] >= snap.frames[hdr[0]].layers.size())
+                return false;
+            pixtile::Plane<u32> &plane = snap.frames[hdr[0]].layers[hdr[1]].px;
+            if (hdr[2] >= plane.tileCols() || hdr[3] >= plane.tileRows())
+                return false;
+            std::vector<u32> px(bytes / 4);
+            std::memcpy(px.data(), payload.data() + sizeof(hdr), bytes);
+            plane.setTile(hdr[2], hdr[3], px.data());
+            return true;
+        }
+        if (type != REC_CANVAS)
+            return false;
+
+        // Frames keep their pixels when their shape is unchanged; the tiles
+        // that follow fill in the rest
+        size_t at = 0;
+        auto get32 = [&](u32 &v)
+        {
+            if (at + 4 > payload.size())
+                return false;
+            std::memcpy(&v, payload.data() + at, 4);
+            at += 4;
+            return true;
+        };
+        u32 w, h, indexed, colors, count;
+        if (!get32(w) || !get32(h) || !get32(indexed) || !get32(colors) || colors > 256)
+            return false;
+        std::vector<sf::Color> palette(colors);
+        for (sf::Color &c : palette)
+        {
+            u32 v;
+            if (!get32(v))
+                return false;
+            c = FrameData::unpack(v);
+        }
+        if (!get32(count) || count > 100000)
+            return false;
+        std::vector<FrameData> frames(count);
+        for (u32 i = 0; i < count; ++i)
+        {
+            u32 len;
+            if (!get32(len) || at + len > payload.size())
+                return false;
+            FrameData &f = frames[i];
+            f.width = w;
+            f.height = h;
+            f.indexed = indexed != 0;
+            if (i < snap.frames.size() && sameShape(snap.frames[i], f))
+                f = snap.frames[i];
+            else if (f.indexed)
+                f.indices.create(w, h, 0);
+            else
+                f.rgba.create(w, h, 0);
+            f.name.assign(payload.data() + at, len);
+            at += len;
+        }
+        for (FrameData &f : frames)
+        {
+            u32 ms;
+            if (!get32(ms))
+                break;
+            f.setDuration(ms);
+        }
+        // layers keep their pixels by position while the frame's shape holds
+        for (FrameData &f : frames)
+        {
+            u32 n;
+            if (!get32(n))
+                break;
+            if (n > pixproj::MAX_LAYERS || (n && f.indexed))
+                return false;
+            std::vector<pixlayer::Layer> layers(n);
+            for (u32 j = 0; j < n; ++j)
+            {
+                u32 attrs, len;
+                if (!get32(attrs) || !get32(len) || at + len > payload.size())
+                    return false;
+                pixlayer::Layer &l = layers[j];
+                if (j < f.layers.size())
+                    l = f.layers[j];
+                else
+                    l.px.create(w, h, 0);
+                l.setAttrs(attrs);
+                l.name.assign(payload.data() + at, len);
+                at += len;
+            }
+            f.layers.swap(layers);
+            f.activeLayer = std::min(f.activeLayer, std::max(0, (int)n - 1));
+        }
+        snap.width = w;
+        snap.height = h;
+        snap.indexed = indexed != 0;
+        snap.palette.swap(palette);
+        snap.frames.swap(frames);
+        return true;
+    }
+};
+
+// Palette lookups on the GPU. The 256x2 lookup texture holds the project
+// palette in row 0 and the palette to display in row 1 (the same, or a
+// swapped variant / colour-cycled version of it).
+// - Indexed frames carry palette indices in their red channel and simply
+//   read row 1.
+// - RGBA frames are only remapped while a preview is active: the shader finds
+//   the pixel's colour in row 0 and substitutes the row 1 entry.
+// Either way a palette edit or variant switch costs one 2KB upload.
+class PaletteShader
+{
+public:
+    bool ok = false;
+    bool remapActive = false;
+    float paletteCount = 0;
+    sf::Shader indexShader;
+    sf::Shader remapShader;
+    sf::Texture lut;
+
+    // GLSL helper shared by every shader that draws frame textures:
+    // lookup(texel, indexed) returns the colour to show for a texel
+    static const std::string &lookupGlsl()
+    {
+        static const std::string src = R"(
+uniform sampler2D palette;
+uniform float count;
+uniform float remap;
+vec4 lookup(vec4 px, float indexed)
+{
+    if (indexed > 0.5)
+        return texture2D(palette, vec2((px.r * 255.0 + 0.5) / 256.0, 0.75));
+    if (remap < 0.5)
+        return px;
+    for (int i = 0; i < 256; ++i)
+    {
+        if (float(i) >= count)
+            break;
+        float u = (float(i) + 0.5) / 256.0;
+        vec4 src = texture2D(palette, vec2(u, 0.25));
+        if (all(lessThan(abs(src - px), vec4(0.5 / 255.0))))
+            return texture2D(palette, vec2(u, 0.75));
+    }
+    return px;
+}
+)";
+        return src;
+    }
+
+    bool init()
+    {
+        if (!sf::Shader::isAvailable())
+            return false;
+        static const std::string indexSrc = lookupGlsl() + R"(
+uniform sampler2D texture;
+void main()
+{
+    gl_FragColor = lookup(texture2D(texture, gl_TexCoord[0].xy), 1.0) * gl_Color;
+}
+)";
+        static const std::string remapSrc = lookupGlsl() + R"(
+uniform sampler2D texture;
+void main()
+{
+    gl_FragColor = lookup(texture2D(texture, gl_TexCoord[0].xy), 0.0) * gl_Color;
+}
+)";
+        ok = indexShader.loadFromMemory(indexSrc, sf::Shader::Fragment) &&
+             remapShader.loadFromMemory(remapSrc, sf::Shader::Fragment) &&
+             lut.create(256, 2);
+        if (ok)
+        {
+            for (sf::Shader *sh : {&indexShader, &remapShader})
+            {
+                sh->setUniform("texture", sf::Shader::CurrentTexture);
+                sh->setUniform("palette", lut);
+            }
+            remapShader.setUniform("remap", 1.0f);
+        }
+        return ok;
+    }
+
+    // Re-uploads the lookup texture only when the palette, the active
+    // variant or the colour-cycle step has changed
+    void sync(const Canvas &canvas, float seconds)
+    {
+        if (!ok)
+            return;
+        unsigned step = canvas.cycleStep(seconds);
+        remapActive = canvas.previewActive();
+        if (canvas.paletteVersion == uploadedPalette && canvas.previewVersion == uploadedPreview && step == uploadedStep)
+            return;
+
+        std::vector<sf::Color> shown = canvas.displayPalette(step);
+        std::vector<u8> px(256 * 2 * 4, 0);
+        for (size_t i = 0; i < canvas.palette.size() && i < 256; ++i)
+        {
+            const sf::Color &a = canvas.palette[i];
+            const sf::Color &b = shown[i];
+            u8 *row0 = &px[i * 4];
+            u8 *row1 = &px[(256 + i) * 4];
+            row0[0] = a.r, row0[1] = a.g, row0[2] = a.b, row0[3] = a.a;
+            row1[0] = b.r, row1[1] = b.g, row1[2] = b.b, row1[3] = b.a;
+        }
+        lut.update(px.data());
+        pixprof::count(pixprof::COUNT_UPLOADS);
+        paletteCount = (float)std::min<size_t>(canvas.palette.size(), 256);
+        remapShader.setUniform("count", paletteCount);
+
+        uploadedPalette = canvas.paletteVersion;
+        uploadedPreview = canvas.previewVersion;
+        uploadedStep = step;
+    }
+
+    // Render states for drawing a frame's texture
+    sf::RenderStates statesFor(const Frame &f) const
+    {
+        if (!ok)
+            return sf::RenderStates::Default;
+        if (f.indexed)
+            return sf::RenderStates(&indexShader);
+        return remapActive ? sf::RenderStates(&remapShader) : sf::RenderStates::Default;
+    }
+
+private:
+    unsigned uploadedPalette = ~0u, uploadedPreview = ~0u, uploadedStep = ~0u;
+};
+
+// GL 2.0; the Windows headers stop at 1.1
+#ifndef GL_MAX_TEXTURE_IMAGE_UNITS
+#define GL_MAX_TEXTURE_IMAGE_UNITS 0x8872
+#endif
+
+// Onion skin: up to MAX_GHOSTS neighbouring frames drawn under the current
+// one with opacity falling off by distance and a tint (warm = earlier,
+// cool = later). Everything is composited in a single shader pass from the
+// frames' cached textures, so the CPU cost does not depend on canvas size.
+// GPUs with too few texture units for all the ghosts get a sprite each.
+class OnionSkin
+{
+public:
+    static const int MAX_GHOSTS = 8;
+    bool ok = false;
+    int ghostSlots = 0; // ghosts the shader samples in one pass
+    sf::Shader shader;
+
+    bool init(const PaletteShader &pal)
+    {
+        if (!pal.ok)
+            return false;
+        // each ghost takes a texture unit besides the frame and the palette;
+        // more ghosts than fit are drawn one sprite each instead
+        GLint units = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+        ghostSlots = std::min(MAX_GHOSTS, (int)units - 2);
+        if (ghostSlots < 1)
+            return false;
+        std::string slots = std::to_string(ghostSlots);
+        std::string src = PaletteShader::lookupGlsl() + R"(
+uniform sampler2D texture;
+uniform float currentIndexed;
+uniform vec4 ghostTint[)" + slots + R"(];
+uniform vec2 ghostParams[)" + slots + R"(]; // x = opacity, y = indexed
+)";
+        for (int i = 0; i < ghostSlots; ++i)
+            src += "uniform sampler2D ghost" + std::to_string(i) + ";\n";
+        src += R"(
+vec4 over(vec4 dst, vec4 src)
+{
+    float a = src.a + dst.a * (1.0 - src.a);
+    if (a <= 0.0)
+        return vec4(0.0);
+    return vec4((src.rgb * src.a + dst.rgb * dst.a * (1.0 - src.a)) / a, a);
+}
+vec4 ghost(sampler2D tex, vec4 tint, vec2 params, vec2 uv)
+{
+    vec4 c = lookup(texture2D(tex, uv), params.y);
+    c.rgb = mix(c.rgb, tint.rgb, tint.a);
+    c.a *= params.x;
+    return c;
+}
+void main()
+{
+    vec2 uv = gl_TexCoord[0].xy;
+    vec4 acc = vec4(0.0);
+)";
+        for (int i = 0; i < ghostSlots; ++i)
+        {
+            std::string n = std::to_string(i);
+            src += "    acc = over(acc, ghost(ghost" + n + ", ghostTint[" + n + "], ghostParams[" + n + "], uv));\n";
+        }
+        src += R"(
+    acc = over(acc, lookup(texture2D(texture, uv), currentIndexed));
+    gl_FragColor = acc * gl_Color;
+}
+)";
+        ok = shader.loadFromMemory(src, sf::Shader::Fragment);
+        if (ok)
+        {
+            shader.setUniform("texture", sf::Shader::CurrentTexture);
+            shader.setUniform("palette", pal.lut);
+        }
+        return ok;
+    }
+
+    // Draws the current frame's sprite with its ghosts underneath
+    void draw(EditorWindow &window, const Canvas &canvas, const sf::Sprite &sprite, const PaletteShader &pal)
+    {
+        struct Ghost
+        {
+            int frame, dist;
+            bool before;
+        };
+        std::vector<Ghost> ghosts;
+        int n = (int)canvas.frames.size(), cur = canvas.currentFrame;
+        auto add = [&](int f, int d, bool before)
+        {
+            if (f == cur || (int)ghosts.size() >= MAX_GHOSTS)
+                return;
+            for (const Ghost &g : ghosts)
+                if (g.frame == f)
+                    return;
+            ghosts.push_back({f, d, before});
+        };
+        int reach = std::max(canvas.onionPrev, canvas.onionNext);
+        for (int d = 1; d <= reach; ++d)
+        {
+            if (d <= canvas.onionPrev)
+                add(((cur - d) % n + n) % n, d, true);
+            if (d <= canvas.onionNext)
+                add((cur + d) % n, d, false);
+        }
+        // farthest first so nearer ghosts end up on top
+        std::stable_sort(ghosts.begin(), ghosts.end(), [](const Ghost &a, const Ghost &b)
+                         { return a.dist > b.dist; });
+
+        auto opacity = [&](const Ghost &g)
+        { return canvas.onionOpacity * std::pow(canvas.onionFalloff, (float)(g.dist - 1)); };
+        auto tint = [&](const Ghost &g)
+        { return g.before ? sf::Color(255, 64, 64) : sf::Color(64, 160, 255); };
+
+        // ghosts share the current frame's size, so the sprite's texture
+        // rect is the visible part of each of them too
+        const Frame &curFrame = canvas.frames[cur];
+        sf::IntRect visible = sprite.getTextureRect();
+        if (!ok || (int)ghosts.size() > ghostSlots)
+        {
+            // Fallback: one sprite per ghost, still from cached textures
+            for (const Ghost &g : ghosts)
+            {
+                const Frame &f = canvas.frames[g.frame];
+                sf::Sprite gs = sprite;
+                gs.setTexture(f.texture(visible));
+                sf::Color c = canvas.onionTint ? tint(g) : sf::Color::White;
+                c.a = (u8)(255 * opacity(g));
+                gs.setColor(c);
+                window.draw(gs, pal.statesFor(f));
+            }
+            window.draw(sprite, pal.statesFor(curFrame));
+            return;
+        }
+
+        for (int i = 0; i < ghostSlots; ++i)
+        {
+            std::string name = "ghost" + std::to_string(i);
+            std::string idx = "[" + std::to_string(i) + "]";
+            if (i < (int)ghosts.size())
+            {
+                const Frame &f = canvas.frames[ghosts[i].frame];
+                sf::Color t = tint(ghosts[i]);
+                shader.setUniform(name, f.texture(visible));
+                shader.setUniform("ghostTint" + idx, sf::Glsl::Vec4(t.r / 255.f, t.g / 255.f, t.b / 255.f, canvas.onionTint ? 0.5f : 0.f));
+                shader.setUniform("ghostParams" + idx, sf::Glsl::Vec2(opacity(ghosts[i]), f.indexed ? 1.f : 0.f));
+            }
+            else
+            {
+                shader.setUniform(name, curFrame.texture(visible));
+                shader.setUniform("ghostParams" + idx, sf::Glsl::Vec2(0.f, 0.f));
+            }
         }
-        return true;
+        shader.setUniform("currentIndexed", curFrame.indexed ? 1.f : 0.f);
+        shader.setUniform("remap", pal.remapActive ? 1.f : 0.f);
+        shader.setUniform("count", pal.paletteCount);
+        window.draw(sprite, sf::RenderStates(&shader));
     }
 };
 
+// Colour picker: the 16 fixed swatches plus an HSV field (a hue ring around
+// a saturation/value square) and an alpha slider. The field is drawn from
+// vertex-coloured geometry the GPU interpolates, so nothing is rasterized
+// on the CPU: within each 60 degree sector the hue is linear in RGB, so a
+// ring with vertices on the sector boundaries is exact, and the square is a
+// white-to-hue quad under a clear-to-black one (colour * value). The
+// geometry is rebuilt only when the colour or the picker's position changes.
 class ColorPicker
 {
 public:
+    static const int RING_STEPS = 96; // ring segments; a multiple of 6
+    static constexpr float RING_OUTER = 82, RING_INNER = 66, SQUARE_HALF = 44;
+
     bool isOpen = false;
     sf::Vector2f position{100, 100};
-    sf::Vector2f size{200, 200};
+    sf::Vector2f size{360, 260};
     Color currentColor{255, 0, 0};
 
-    void draw(sf::RenderWindow &window, sf::Font &font)
+    // Follows colour changes made elsewhere (eyedropper, Shift+click edits)
+    void sync(const Color &c)
+    {
+        if (!same(c, currentColor))
+            setColor(c);
+    }
+
+    void draw(EditorWindow &window, sf::Font &font)
     {
         if (!isOpen)
             return;
@@ -405,10 +2624,18 @@ public:
             }
         }
 
-        // Current color preview with 8-bit style
+        // HSV field and alpha slider from the cached geometry
+        if (!built || builtAt != position)
+            rebuild();
+        window.draw(ring);
+        window.draw(square);
+        window.draw(alphaBar);
+        drawMarkers(window);
+
+        // Current color preview with 8-bit style, over the alpha checkerboard
         sf::RectangleShape preview({60, 40});
-        preview.setPosition(position.x + size.x - 70, position.y + size.y - 50);
-        preview.setFillColor(sf::Color(currentColor.r, currentColor.g, currentColor.b));
+        preview.setPosition(position.x + 10, position.y + size.y - 50);
+        preview.setFillColor(sf::Color(currentColor.r, currentColor.g, currentColor.b, currentColor.a));
         preview.setOutlineColor(sf::Color(EightBitColors::White.r, EightBitColors::White.g, EightBitColors::White.b));
         preview.setOutlineThickness(2);
         window.draw(preview);
@@ -428,11 +2655,25 @@ public:
         window.draw(closeText);
     }
 
+    // Called every UI frame while the left button is down. A press on the
+    // ring, square or slider grabs it, and the drag keeps picking from it
+    // until release() even when the mouse leaves it.
     bool handleClick(sf::Vector2i mousePos, Color &targetColor)
     {
         if (!isOpen)
             return false;
 
+        sf::Vector2f p((float)mousePos.x, (float)mousePos.y);
+        if (!held)
+            grabbed = partAt(p);
+        held = true;
+        if (grabbed != PART_NONE)
+        {
+            pick(grabbed, p);
+            targetColor = currentColor;
+            return true;
+        }
+
         // Check color palette clicks
         float cellSize = 30;
         float startX = position.x + 10;
@@ -451,7 +2692,7 @@ public:
 
             if (colorRect.contains(mousePos.x, mousePos.y))
             {
-                currentColor = EightBitColors::Palette[i];
+                setColor(Color(EightBitColors::Palette[i].r, EightBitColors::Palette[i].g, EightBitColors::Palette[i].b, currentColor.a));
                 targetColor = currentColor;
                 return true;
             }
@@ -467,10 +2708,224 @@ public:
 
         return false;
     }
+
+    // Ends a drag; called when the left button is up
+    void release()
+    {
+        held = false;
+        grabbed = PART_NONE;
+    }
+
+private:
+    enum Part
+    {
+        PART_NONE,
+        PART_RING,
+        PART_SQUARE,
+        PART_ALPHA
+    };
+
+    float hue = 0, sat = 1, val = 1; // hue in degrees
+    bool held = false;
+    Part grabbed = PART_NONE;
+
+    sf::VertexArray ring{sf::TriangleStrip}, square{sf::Quads}, alphaBar{sf::Quads};
+    bool built = false;
+    sf::Vector2f builtAt;
+
+    static bool same(const Color &a, const Color &b)
+    {
+        return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+    }
+
+    static Color fromHsv(float h, float s, float v, u8 a)
+    {
+        float c = v * s, hp = std::fmod(h, 360.f) / 60.f;
+        float x = c * (1 - std::fabs(std::fmod(hp, 2.f) - 1));
+        float r = 0, g = 0, b = 0;
+        switch ((int)hp)
+        {
+        case 0: r = c, g = x; break;
+        case 1: r = x, g = c; break;
+        case 2: g = c, b = x; break;
+        case 3: g = x, b = c; break;
+        case 4: r = x, b = c; break;
+        default: r = c, b = x; break;
+        }
+        float m = v - c;
+        auto byte = [&](float f)
+        { return (u8)std::lround((f + m) * 255); };
+        return Color(byte(r), byte(g), byte(b), a);
+    }
+
+    // Takes c's hue, saturation and value; greys keep the current hue and
+    // black the current saturation, so dragging through them is stable
+    void setColor(const Color &c)
+    {
+        float r = c.r / 255.f, g = c.g / 255.f, b = c.b / 255.f;
+        float mx = std::max({r, g, b}), d = mx - std::min({r, g, b});
+        val = mx;
+        if (mx > 0)
+            sat = d / mx;
+        if (d > 0)
+        {
+            float h = mx == r ? std::fmod((g - b) / d, 6.f) : mx == g ? (b - r) / d + 2 : (r - g) / d + 4;
+            hue = h < 0 ? h * 60 + 360 : h * 60;
+        }
+        currentColor = c;
+        built = false;
+    }
+
+    sf::Vector2f ringCentre() const { return {position.x + 260, position.y + 110}; }
+    sf::FloatRect alphaRect() const { return {position.x + 10, position.y + 176, 136, 16}; }
+
+    Part partAt(sf::Vector2f p) const
+    {
+        sf::Vector2f d = p - ringCentre();
+        float r = std::sqrt(d.x * d.x + d.y * d.y);
+        if (r >= RING_INNER && r <= RING_OUTER)
+            return PART_RING;
+        if (std::fabs(d.x) <= SQUARE_HALF && std::fabs(d.y) <= SQUARE_HALF)
+            return PART_SQUARE;
+        if (alphaRect().contains(p))
+            return PART_ALPHA;
+        return PART_NONE;
+    }
+
+    void pick(Part part, sf::Vector2f p)
+    {
+        auto unit = [](float f)
+        { return std::min(1.f, std::max(0.f, f)); };
+        sf::Vector2f d = p - ringCentre();
+        u8 alpha = currentColor.a;
+        float prevHue = hue, prevSat = sat, prevVal = val;
+        if (part == PART_RING)
+        {
+            float h = std::atan2(d.y, d.x) * 180.f / 3.14159265f;
+            hue = h < 0 ? h + 360 : h;
+        }
+        else if (part == PART_SQUARE)
+        {
+            sat = unit((d.x + SQUARE_HALF) / (2 * SQUARE_HALF));
+            val = 1 - unit((d.y + SQUARE_HALF) / (2 * SQUARE_HALF));
+        }
+        else if (part == PART_ALPHA)
+        {
+            sf::FloatRect a = alphaRect();
+            alpha = (u8)std::lround(unit((p.x - a.left) / a.width) * 255);
+        }
+        if (hue != prevHue || sat != prevSat || val != prevVal || alpha != currentColor.a)
+            built = false;
+        currentColor = fromHsv(hue, sat, val, alpha);
+    }
+
+    void rebuild()
+    {
+        sf::Vector2f o = ringCentre();
+        ring.clear();
+        for (int i = 0; i <= RING_STEPS; ++i)
+        {
+            float deg = 360.f * i / RING_STEPS, rad = deg * 3.14159265f / 180.f;
+            Color h = fromHsv(deg, 1, 1, 255);
+            sf::Color c(h.r, h.g, h.b);
+            sf::Vector2f dir(std::cos(rad), std::sin(rad));
+            ring.append(sf::Vertex(o + dir * RING_INNER, c));
+            ring.append(sf::Vertex(o + dir * RING_OUTER, c));
+        }
+
+        // white-to-hue across, then clear-to-black down over it
+        Color h = fromHsv(hue, 1, 1, 255);
+        sf::Color pure(h.r, h.g, h.b), clear(0, 0, 0, 0);
+        float l = o.x - SQUARE_HALF, r = o.x + SQUARE_HALF, t = o.y - SQUARE_HALF, b = o.y + SQUARE_HALF;
+        square.clear();
+        square.append(sf::Vertex({l, t}, sf::Color::White));
+        square.append(sf::Vertex({r, t}, pure));
+        square.append(sf::Vertex({r, b}, pure));
+        square.append(sf::Vertex({l, b}, sf::Color::White));
+        square.append(sf::Vertex({l, t}, clear));
+        square.append(sf::Vertex({r, t}, clear));
+        square.append(sf::Vertex({r, b}, sf::Color::Black));
+        square.append(sf::Vertex({l, b}, sf::Color::Black));
+
+        // checkerboard, then the colour from clear to opaque; the preview
+        // swatch gets a checkerboard of its own
+        alphaBar.clear();
+        sf::FloatRect a = alphaRect();
+        checker(a);
+        sf::Color c0(currentColor.r, currentColor.g, currentColor.b, 0), c1(currentColor.r, currentColor.g, currentColor.b, 255);
+        alphaBar.append(sf::Vertex({a.left, a.top}, c0));
+        alphaBar.append(sf::Vertex({a.left + a.width, a.top}, c1));
+        alphaBar.append(sf::Vertex({a.left + a.width, a.top + a.height}, c1));
+        alphaBar.append(sf::Vertex({a.left, a.top + a.height}, c0));
+        checker({position.x + 10, position.y + size.y - 50, 60, 40});
+
+        built = true;
+        builtAt = position;
+    }
+
+    void checker(const sf::FloatRect &area)
+    {
+        const float cell = 8;
+        sf::Color light(EightBitColors::LightGray.r, EightBitColors::LightGray.g, EightBitColors::LightGray.b);
+        sf::Color dark(EightBitColors::DarkGray.r, EightBitColors::DarkGray.g, EightBitColors::DarkGray.b);
+        for (float y = 0; y < area.height; y += cell)
+            for (float x = 0; x < area.width; x += cell)
+            {
+                sf::Color c = ((int)(x / cell) + (int)(y / cell)) % 2 ? dark : light;
+                float x0 = area.left + x, y0 = area.top + y;
+                float x1 = area.left + std::min(x + cell, area.width), y1 = area.top + std::min(y + cell, area.height);
+                alphaBar.append(sf::Vertex({x0, y0}, c));
+                alphaBar.append(sf::Vertex({x1, y0}, c));
+                alphaBar.append(sf::Vertex({x1, y1}, c));
+                alphaBar.append(sf::Vertex({x0, y1}, c));
+            }
+    }
+
+    // Hue tick on the ring, ring around the SV point, tick on the slider
+    void drawMarkers(EditorWindow &window)
+    {
+        sf::Color white(EightBitColors::White.r, EightBitColors::White.g, EightBitColors::White.b);
+        sf::Vector2f o = ringCentre();
+        float rad = hue * 3.14159265f / 180.f;
+
+        sf::RectangleShape tick({RING_OUTER - RING_INNER + 4, 3});
+        tick.setOrigin(0, 1.5f);
+        tick.setPosition(o + sf::Vector2f(std::cos(rad), std::sin(rad)) * (RING_INNER - 2));
+        tick.setRotation(hue);
+        tick.setFillColor(sf::Color::Black);
+        tick.setOutlineColor(white);
+        tick.setOutlineThickness(1);
+        window.draw(tick);
+
+        sf::CircleShape dot(4);
+        dot.setOrigin(4, 4);
+        dot.setPosition(o.x - SQUARE_HALF + sat * 2 * SQUARE_HALF, o.y + SQUARE_HALF - val * 2 * SQUARE_HALF);
+        dot.setFillColor(sf::Color::Transparent);
+        dot.setOutlineColor(val > 0.5f ? sf::Color::Black : white);
+        dot.setOutlineThickness(2);
+        window.draw(dot);
+
+        sf::FloatRect a = alphaRect();
+        sf::RectangleShape slider({3, a.height + 4});
+        slider.setPosition(a.left + a.width * currentColor.a / 255.f - 1.5f, a.top - 2);
+        slider.setFillColor(white);
+        window.draw(slider);
+    }
 };
 
+// Status bar part for the current frame's layer stack; empty when flat
+std::string layerStatus(const Frame &f)
+{
+    if (f.layers.empty())
+        return std::string();
+    const pixlayer::Layer &l = f.layers[f.activeLayer];
+    return "  LAYER " + std::to_string(f.activeLayer + 1) + "/" + std::to_string(f.layers.size()) + " " +
+           pixlayer::blendName(l.blend) + " " + std::to_string((int)std::lround(l.opacity * 100 / 255.0)) + "%" +
+           (l.visible ? "" : " HIDDEN");
+}
+
 // Utility: draw a rectangle button with 8-bit style
-void drawButton(sf::RenderWindow &w, const sf::FloatRect &rect, const sf::Font &font,
+void drawButton(EditorWindow &w, const sf::FloatRect &rect, const sf::Font &font,
                 const std::string &label, bool isActive = false, bool isHovered = false)
 {
     // 8-bit button style
@@ -499,7 +2954,7 @@ void drawButton(sf::RenderWindow &w, const sf::FloatRect &rect, const sf::Font &
 }
 
 // Draw 8-bit style panel
-void drawPanel(sf::RenderWindow &w, const sf::FloatRect &rect, const std::string &title = "", const sf::Font &font = sf::Font())
+void drawPanel(EditorWindow &w, const sf::FloatRect &rect, const std::string &title = "", const sf::Font &font = sf::Font())
 {
     // Main panel
     sf::RectangleShape panel({rect.width, rect.height});
@@ -520,15 +2975,376 @@ void drawPanel(sf::RenderWindow &w, const sf::FloatRect &rect, const std::string
     }
 }
 
-int main()
+// Profiler HUD: per-phase times, counters and a stacked frame-time history
+void drawProfilerHud(EditorWindow &w, const sf::Font &font)
+{
+    const pixprof::Profiler &prof = pixprof::profiler();
+    const float barW = 2, graphH = 60, msScale = graphH / 33.3f; // two 60 Hz frames fill the graph
+    sf::FloatRect r(8, 8, pixprof::HISTORY * barW + 16, 244);
+
+    sf::RectangleShape bg({r.width, r.height});
+    bg.setPosition(r.left, r.top);
+    bg.setFillColor(sf::Color(0, 0, 0, 190));
+    bg.setOutlineColor(sf::Color(EightBitColors::LightGray.r, EightBitColors::LightGray.g, EightBitColors::LightGray.b));
+    bg.setOutlineThickness(1);
+    w.draw(bg);
+
+    sf::Text t(prof.summary(), font, 11);
+    t.setPosition(r.left + 8, r.top + 6);
+    t.setFillColor(sf::Color(EightBitColors::White.r, EightBitColors::White.g, EightBitColors::White.b));
+    w.draw(t);
+
+    // One stacked bar per frame, phases bottom-up, in a single draw call
+    float baseY = r.top + r.height - 8;
+    sf::VertexArray bars(sf::Quads);
+    for (int i = 0; i < pixprof::HISTORY; ++i)
+    {
+        int f = (prof.head + i) % pixprof::HISTORY;
+        float x = r.left + 8 + i * barW, y = baseY;
+        for (int p = 0; p < pixprof::PHASE_COUNT; ++p)
+        {
+            float h = std::min(prof.phaseMs[f][p] * msScale, y - (baseY - graphH));
+            if (h <= 0)
+                continue;
+            u32 c = pixprof::phaseColor(p);
+            sf::Color col((c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF);
+            bars.append(sf::Vertex({x, y - h}, col));
+            bars.append(sf::Vertex({x + barW, y - h}, col));
+            bars.append(sf::Vertex({x + barW, y}, col));
+            bars.append(sf::Vertex({x, y}, col));
+            y -= h;
+        }
+    }
+    // 16.7 ms reference line
+    float refY = baseY - 16.7f * msScale;
+    sf::Color refCol(255, 255, 255, 120);
+    bars.append(sf::Vertex({r.left + 8, refY}, refCol));
+    bars.append(sf::Vertex({r.left + 8 + pixprof::HISTORY * barW, refY}, refCol));
+    bars.append(sf::Vertex({r.left + 8 + pixprof::HISTORY * barW, refY + 1}, refCol));
+    bars.append(sf::Vertex({r.left + 8, refY + 1}, refCol));
+    w.draw(bars);
+}
+
+// Everything the main loop reads from the outside world in one iteration:
+// the elapsed time, the SFML events and the real-time mouse/key state it
+// polls. --record writes each iteration to a tape; --replay feeds a tape back
+// in place of the window, so a session reproduces exactly whatever the frame
+// rate was and can be benchmarked across builds.
+class InputTape
+{
+public:
+    enum Mode
+    {
+        Live,
+        Record,
+        Replay
+    };
+
+    Mode mode = Live;
+    size_t ticks = 0;
+
+    bool open(Mode m, const std::string &path)
+    {
+        mode = m;
+        if (mode == Record)
+        {
+            out.open(path, std::ios::binary);
+            out.write("PIXR", 4);
+            put32(VERSION);
+            return (bool)out;
+        }
+        if (mode == Replay)
+        {
+            in.open(path, std::ios::binary);
+            char magic[5] = {0};
+            in.read(magic, 4);
+            return in && std::string(magic) == "PIXR" && get32() == VERSION;
+        }
+        return true;
+    }
+
+    // Gathers one iteration of input. Returns false once a replay is exhausted.
+    bool next(sf::RenderWindow &window, float realDt)
+    {
+        events.clear();
+        cursor = 0;
+        sf::Event ev;
+        if (mode == Replay)
+        {
+            // the hidden window's own events are drained and ignored
+            while (window.pollEvent(ev))
+                ;
+            return readTick();
+        }
+
+        delta = realDt;
+        while (window.pollEvent(ev))
+            events.push_back(ev);
+        mousePos = sf::Mouse::getPosition(window);
+        keys = 0;
+        for (int i = 0; i < KEY_COUNT; ++i)
+            if (sf::Keyboard::isKeyPressed(TRACKED_KEYS[i]))
+                keys |= 1u << i;
+        if (mode == Record)
+            writeTick();
+        ++ticks;
+        return true;
+    }
+
+    bool pollEvent(sf::Event &ev)
+    {
+        if (cursor >= events.size())
+            return false;
+        ev = events[cursor++];
+        return true;
+    }
+
+    float dt() const { return delta; }
+    sf::Vector2i mouse() const { return mousePos; }
+
+    bool keyDown(sf::Keyboard::Key key) const
+    {
+        for (int i = 0; i < KEY_COUNT; ++i)
+            if (TRACKED_KEYS[i] == key)
+                return (keys >> i) & 1;
+        return false;
+    }
+
+private:
+    static const u32 VERSION = 1;
+    static const int KEY_COUNT = 5;
+    static constexpr sf::Keyboard::Key TRACKED_KEYS[KEY_COUNT] = {sf::Keyboard::Space, sf::Keyboard::LShift, sf::Keyboard::RShift,
+                                                                  sf::Keyboard::LControl, sf::Keyboard::RControl};
+
+    std::ofstream out;
+    std::ifstream in;
+    std::vector<sf::Event> events;
+    size_t cursor = 0;
+    float delta = 0;
+    sf::Vector2i mousePos;
+    u32 keys = 0;
+
+    void put32(u32 v) { out.write((const char *)&v, 4); }
+    u32 get32()
+    {
+        u32 v = 0;
+        in.read((char *)&v, 4);
+        return v;
+    }
+    void putF(float f)
+    {
+        u32 v;
+        std::memcpy(&v, &f, 4);
+        put32(v);
+    }
+    float getF()
+    {
+        u32 v = get32();
+        float f;
+        std::memcpy(&f, &v, 4);
+        return f;
+    }
+
+    // Tick: dt, mouse x/y, key bits, event count, then per event its type
+    // and the fields of that type the editor reads
+    void writeTick()
+    {
+        putF(delta);
+        put32((u32)mousePos.x);
+        put32((u32)mousePos.y);
+        put32(keys);
+        put32((u32)events.size());
+        for (const sf::Event &ev : events)
+        {
+            put32((u32)ev.type);
+            switch (ev.type)
+            {
+            case sf::Event::KeyPressed:
+            case sf::Event::KeyReleased:
+                put32((u32)ev.key.code);
+                put32((ev.key.alt ? 1u : 0u) | (ev.key.control ? 2u : 0u) | (ev.key.shift ? 4u : 0u) | (ev.key.system ? 8u : 0u));
+                break;
+            case sf::Event::TextEntered:
+                put32(ev.text.unicode);
+                break;
+            case sf::Event::MouseButtonPressed:
+            case sf::Event::MouseButtonReleased:
+                put32((u32)ev.mouseButton.button);
+                put32((u32)ev.mouseButton.x);
+                put32((u32)ev.mouseButton.y);
+                break;
+            case sf::Event::MouseMoved:
+                put32((u32)ev.mouseMove.x);
+                put32((u32)ev.mouseMove.y);
+                break;
+            case sf::Event::MouseWheelScrolled:
+                put32((u32)ev.mouseWheelScroll.wheel);
+                putF(ev.mouseWheelScroll.delta);
+                put32((u32)ev.mouseWheelScroll.x);
+                put32((u32)ev.mouseWheelScroll.y);
+                break;
+            case sf::Event::Resized:
+                put32(ev.size.width);
+                put32(ev.size.height);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    bool readTick()
+    {
+        delta = getF();
+        mousePos.x = (int)get32();
+        mousePos.y = (int)get32();
+        keys = get32();
+        u32 count = get32();
+        if (!in)
+            return false;
+        for (u32 i = 0; i < count && in; ++i)
+        {
+            sf::Event ev;
+            std::memset(&ev, 0, sizeof(ev));
+            ev.type = (sf::Event::EventType)get32();
+            switch (ev.type)
+            {
+            case sf::Event::KeyPressed:
+            case sf::Event::KeyReleased:
+            {
+                ev.key.code = (sf::Keyboard::Key)get32();
+                u32 mods = get32();
+                ev.key.alt = mods & 1;
+                ev.key.control = mods & 2;
+                ev.key.shift = mods & 4;
+                ev.key.system = mods & 8;
+                break;
+            }
+            case sf::Event::TextEntered:
+                ev.text.unicode = get32();
+                break;
+            case sf::Event::MouseButtonPressed:
+            case sf::Event::MouseButtonReleased:
+                ev.mouseButton.button = (sf::Mouse::Button)get32();
+                ev.mouseButton.x = (int)get32();
+                ev.mouseButton.y = (int)get32();
+                break;
+            case sf::Event::MouseMoved:
+                ev.mouseMove.x = (int)get32();
+                ev.mouseMove.y = (int)get32();
+                break;
+            case sf::Event::MouseWheelScrolled:
+                ev.mouseWheelScroll.wheel = (sf::Mouse::Wheel)get32();
+                ev.mouseWheelScroll.delta = getF();
+                ev.mouseWheelScroll.x = (int)get32();
+                ev.mouseWheelScroll.y = (int)get32();
+                break;
+            case sf::Event::Resized:
+                ev.size.width = get32();
+                ev.size.height = get32();
+                break;
+            default:
+                break;
+            }
+            events.push_back(ev);
+        }
+        if (!in)
+            return false;
+        ++ticks;
+        return true;
+    }
+};
+
+int main(int argc, char **argv)
 {
+    // --record <file> logs this session's input, --replay <file> runs a
+    // recorded one without showing the window and prints timings and a hash.
+    // --import <png or directory> starts from imported PNGs, sliced into
+    // --cell WxH cells (automatically without it).
+    // --video <file or -> renders the animation as uncompressed video and
+    // exits without opening a window; see exportVideo for the options.
+    InputTape tape;
+    std::string importPath, videoPath;
+    unsigned cellW = 0, cellH = 0;
+    unsigned videoFps = 30, videoLoops = 1;
+    int videoScale = 1;
+    pixvideo::Format videoFormat = pixvideo::FORMAT_Y4M_420;
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--record" || arg == "--replay")
+        {
+            const char *path = argv[++i];
+            if (!tape.open(arg == "--record" ? InputTape::Record : InputTape::Replay, path))
+            {
+                std::cerr << "Cannot open input tape " << path << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--import")
+            importPath = argv[++i];
+        else if (arg == "--cell" && std::sscanf(argv[++i], "%ux%u", &cellW, &cellH) != 2)
+        {
+            std::cerr << "--cell expects WxH, e.g. 16x16\n";
+            return 1;
+        }
+        else if (arg == "--video")
+            videoPath = argv[++i];
+        else if (arg == "--video-fps")
+            videoFps = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--video-loops")
+            videoLoops = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--video-scale")
+            videoScale = std::max(1, std::min(pixup::MAX_SCALE, std::atoi(argv[++i])));
+        else if (arg == "--video-format" && !pixvideo::parseFormat(argv[++i], videoFormat))
+        {
+            std::cerr << "--video-format expects y4m, y4m444 or rgba\n";
+            return 1;
+        }
+    }
+    bool replaying = tape.mode == InputTape::Replay;
+
+    // Video on stdout: keep it clean by sending messages to stderr
+    if (videoPath == "-")
+        std::cout.rdbuf(std::cerr.rdbuf());
+
+    // PIX_TRACE=1 records a trace from launch; F4 starts/stops one later
+    pixtrace::setThreadName("main");
+    if (std::getenv("PIX_TRACE"))
+        pixtrace::start();
+
     // Basic parameters
     unsigned initW = 64, initH = 64;
     Canvas canvas(initW, initH);
 
+    // Autosave journal beside project.pix; picks up work lost in a crash
+    Autosave autosave("project.pix");
+    autosave.enabled = !replaying && videoPath.empty();
+    if (autosave.enabled)
+        autosave.recover(canvas);
+    if (!importPath.empty() && canvas.importPNG(importPath, cellW, cellH))
+        std::cout << "Imported " << canvas.frames.size() << " frames from " << importPath << "\n";
+
+    // Headless video export of the imported PNGs or the saved project
+    if (!videoPath.empty())
+    {
+        if (importPath.empty() && !canvas.loadFromPix("project.pix") && !canvas.loadFromPix("project.pxl"))
+        {
+            std::cerr << "No project.pix or project.pxl to render (or pass --import)\n";
+            return 1;
+        }
+        canvas.exportScale = videoScale;
+        pixjobs::Handle job = canvas.exportVideo(videoPath, videoFormat, videoFps, videoLoops);
+        pixjobs::pool().wait(job);
+        pixjobs::pool().runCompletions();
+        return job->isCancelled() ? 1 : 0;
+    }
+
     // Window & view setup
-    sf::RenderWindow window(sf::VideoMode(1100, 700), "PIXEL8 - 8-Bit Pixel Editor", sf::Style::Close | sf::Style::Titlebar);
-    window.setVerticalSyncEnabled(true);
+    EditorWindow window(sf::VideoMode(1100, 700), "PIXEL8 - 8-Bit Pixel Editor", sf::Style::Close | sf::Style::Titlebar);
+    window.setVerticalSyncEnabled(!replaying);
+    if (replaying)
+        window.setVisible(false); // UI hit-testing lives in the draw code, so it still renders off-screen
 
     // Load a retro-style font
     sf::Font font;
@@ -541,18 +3357,31 @@ int main()
         }
     }
 
+    // GPU palette lookup for indexed-colour mode
+    PaletteShader paletteShader;
+    paletteShader.init();
+    OnionSkin onionSkin;
+    onionSkin.init(paletteShader);
+    float previewTime = 0.f; // drives colour cycling
+    bool cycleMarkFirst = true;
+
     bool running = true;
     bool leftMouseDown = false, middleMouseDown = false;
     sf::Vector2i lastMouse;
     bool isSpacePan = false;
 
     // Animation preview
-    bool playing = false;
-    float fps = 6.0f;
-    float playTimer = 0.f;
+    Playback playback;
+    MipView mipView;
+    GridOverlay gridOverlay;
+    int shownFrame = -1; // frame drawn last UI frame, to spot scrubbing
+
+    // Background save / export running on the job pool
+    pixjobs::Handle saveJob, exportJob, importJob;
 
     // Color picker
     ColorPicker colorPicker;
+    int editingSlot = -1; // palette slot a Shift+drag in the picker is recolouring
 
     // Canvas resize dialog
     bool showResizeDialog = false;
@@ -585,7 +3414,10 @@ int main()
     sf::Clock clock;
     while (running)
     {
-        float dt = clock.restart().asSeconds();
+        if (!tape.next(window, clock.restart().asSeconds()))
+            break; // end of replay
+        float dt = tape.dt();
+        pixprof::profiler().frame();
 
         // Reset UI click tracking (but keep track of specific button clicks)
         uiElementClicked = false;
@@ -593,8 +3425,9 @@ int main()
         hoveredFrameButton = -1;
 
         // event handling
+        pixprof::phase(pixprof::PHASE_EVENTS);
         sf::Event ev;
-        while (window.pollEvent(ev))
+        while (tape.pollEvent(ev))
         {
             if (ev.type == sf::Event::Closed)
                 running = false;
@@ -604,8 +3437,8 @@ int main()
                     canvas.zoom *= 1.1f;
                 else
                     canvas.zoom /= 1.1f;
-                if (canvas.zoom < 1.0f)
-                    canvas.zoom = 1.0f;
+                if (canvas.zoom < MipView::MIN_ZOOM)
+                    canvas.zoom = MipView::MIN_ZOOM;
                 if (canvas.zoom > 64.0f)
                     canvas.zoom = 64.0f;
             }
@@ -620,7 +3453,7 @@ int main()
                 }
                 if (ev.mouseButton.button == sf::Mouse::Middle)
                     middleMouseDown = true;
-                lastMouse = sf::Mouse::getPosition(window);
+                lastMouse = tape.mouse();
             }
             else if (ev.type == sf::Event::MouseButtonReleased)
             {
@@ -639,21 +3472,37 @@ int main()
                 {
                     canvas.newProject(64, 64);
                 }
+                else if (ctrl && ev.key.shift && ev.key.code == sf::Keyboard::S)
+                {
+                    // export frames as PNG sequence (checked before plain Ctrl+S)
+                    if (exportJob && !exportJob->finished)
+                        std::cout << "Export already running\n";
+                    else
+                        exportJob = canvas.exportAllFramesPNG("export/frame");
+                }
                 else if (ctrl && ev.key.code == sf::Keyboard::S)
                 {
-                    // save
-                    canvas.saveToPix("project.pix");
-                    std::cout << "Saved project.pix\n";
+                    // save in the background
+                    saveJob = autosave.save(canvas);
                 }
-                else if (ctrl && ev.key.shift && ev.key.code == sf::Keyboard::S)
+                else if (ctrl && ev.key.shift && ev.key.code == sf::Keyboard::O)
+                {
+                    // import the PNGs in import/ (checked before plain Ctrl+O),
+                    // decoded in the background
+                    if (importJob && !importJob->finished)
+                        std::cout << "Import already running\n";
+                    else
+                        importJob = canvas.importPNGInBackground("import");
+                }
+                else if (ctrl && ev.key.code == sf::Keyboard::O)
                 {
-                    // export frames as PNG sequence
-                    canvas.exportAllFramesPNG("export/frame");
-                    std::cout << "Exported frames to export/frame_#.png\n";
+                    // load project.pix, or the SDL build's project.pxl
+                    if (canvas.loadFromPix("project.pix") || canvas.loadFromPix("project.pxl"))
+                        std::cout << "Loaded project (" << canvas.frames.size() << " frames)\n";
                 }
                 else if (ev.key.code == sf::Keyboard::Space)
                 {
-                    playing = !playing;
+                    playback.toggle();
                 }
                 else if (ev.key.code == sf::Keyboard::G)
                 {
@@ -663,6 +3512,154 @@ int main()
                 {
                     canvas.onionSkin = !canvas.onionSkin;
                 }
+                else if (ev.key.code == sf::Keyboard::F3)
+                {
+                    pixprof::profiler().visible = !pixprof::profiler().visible;
+                }
+                else if (ev.key.code == sf::Keyboard::F4)
+                {
+                    // start a trace capture, or stop and write it out
+                    if (!pixtrace::enabled())
+                    {
+                        pixtrace::start();
+                        std::cout << "Tracing started\n";
+                    }
+                    else
+                    {
+                        pixtrace::stop();
+                        if (pixtrace::dump("trace.json"))
+                            std::cout << "Wrote trace.json\n";
+                    }
+                }
+                else if (ev.key.code == sf::Keyboard::F5)
+                {
+                    // render the animation to export/anim.y4m in the background
+                    if (exportJob && !exportJob->finished)
+                        std::cout << "Export already running\n";
+                    else
+                        exportJob = canvas.exportVideo("export/anim.y4m", pixvideo::FORMAT_Y4M_420, 30);
+                }
+                else if ((ev.key.code == sf::Keyboard::LBracket || ev.key.code == sf::Keyboard::RBracket) && !renamingFrame)
+                {
+                    // [ / ] change how many earlier ghost frames are shown,
+                    // with Shift how many later ones
+                    int &count = ev.key.shift ? canvas.onionNext : canvas.onionPrev;
+                    count += ev.key.code == sf::Keyboard::RBracket ? 1 : -1;
+                    count = std::max(0, std::min(OnionSkin::MAX_GHOSTS / 2, count));
+                }
+                else if (ctrl && ev.key.code == sf::Keyboard::I)
+                {
+                    // toggle indexed-colour (8-bit palette) storage
+                    if (canvas.indexedMode || paletteShader.ok)
+                    {
+                        canvas.setIndexedMode(!canvas.indexedMode);
+                        std::cout << (canvas.indexedMode ? "Indexed colour mode on\n" : "Indexed colour mode off\n");
+                    }
+                    else
+                        std::cerr << "Indexed colour mode needs shader support\n";
+                }
+                else if (ev.key.code == sf::Keyboard::V && !renamingFrame && !showResizeDialog)
+                {
+                    // Shift+V: new palette variant from what is on screen; V: cycle variants
+                    if (ev.key.shift)
+                        canvas.addPaletteVariant();
+                    else
+                        canvas.nextPaletteVariant();
+                }
+                else if (ev.key.code == sf::Keyboard::C && !ctrl && !renamingFrame && !showResizeDialog)
+                {
+                    // Shift+C marks the current colour as the first / last slot
+                    // of the cycle range; C toggles colour cycling
+                    if (ev.key.shift)
+                    {
+                        // nearest slot: marking a range never adds colours
+                        int slot = canvas.findPaletteIndex(sf::Color(canvas.drawColor.r, canvas.drawColor.g, canvas.drawColor.b, canvas.drawColor.a), true);
+                        if (cycleMarkFirst)
+                            canvas.setCycleRange(slot, std::max(slot, canvas.cycleLast));
+                        else
+                            canvas.setCycleRange(canvas.cycleFirst, slot);
+                        cycleMarkFirst = !cycleMarkFirst;
+                    }
+                    else
+                    {
+                        canvas.colorCycling = !canvas.colorCycling;
+                        ++canvas.previewVersion;
+                    }
+                }
+                else if (ev.key.code == sf::Keyboard::X && !renamingFrame && !showResizeDialog)
+                {
+                    // cycle export upscale factor
+                    static const int scales[] = {1, 2, 3, 4, 6, 8};
+                    int i = 0;
+                    while (i < 5 && scales[i] != canvas.exportScale)
+                        ++i;
+                    canvas.exportScale = scales[(i + 1) % 6];
+                }
+                else if (ev.key.code == sf::Keyboard::M && !renamingFrame && !showResizeDialog)
+                {
+                    // cycle export upscale filter
+                    canvas.exportMode = (pixup::Mode)((canvas.exportMode + 1) % pixup::MODE_COUNT);
+                }
+                else if (ctrl && ev.key.code == sf::Keyboard::H)
+                {
+                    // export the frames as a C++ header
+                    if (canvas.exportHeader("export/sprite.h"))
+                        std::cout << "Exported export/sprite.h\n";
+                }
+                else if (ev.key.code == sf::Keyboard::H && !renamingFrame && !showResizeDialog)
+                {
+                    // cycle header format, then the same formats with RLE
+                    int next = canvas.headerFormat + 1;
+                    if (next == pixcexport::FORMAT_COUNT)
+                    {
+                        next = 0;
+                        canvas.headerRLE = !canvas.headerRLE;
+                    }
+                    canvas.headerFormat = (pixcexport::Format)next;
+                }
+                else if (ev.key.code == sf::Keyboard::L && !renamingFrame && !showResizeDialog)
+                {
+                    // Ctrl+L: new layer above the current one, Ctrl+Shift+L:
+                    // delete it; L / Shift+L: select the layer above / below
+                    Frame &f = canvas.frames[canvas.currentFrame];
+                    if (ctrl && ev.key.shift)
+                        f.deleteLayer();
+                    else if (ctrl)
+                    {
+                        if (!f.addLayer())
+                            std::cout << "Layers need RGBA frames (Ctrl+I leaves indexed mode)\n";
+                    }
+                    else if (!f.layers.empty())
+                    {
+                        int n = (int)f.layers.size();
+                        f.activeLayer = (f.activeLayer + (ev.key.shift ? n - 1 : 1)) % n;
+                    }
+                }
+                else if (ev.key.code == sf::Keyboard::B && !ctrl && !renamingFrame && !showResizeDialog)
+                {
+                    // B cycles the current layer's blend mode, Shift+B hides / shows it
+                    Frame &f = canvas.frames[canvas.currentFrame];
+                    if (!f.layers.empty())
+                    {
+                        const pixlayer::Layer &l = f.layers[f.activeLayer];
+                        if (ev.key.shift)
+                            f.styleLayer(!l.visible, l.opacity, l.blend);
+                        else
+                            f.styleLayer(l.visible, l.opacity, (pixlayer::Blend)((l.blend + 1) % pixlayer::BLEND_COUNT));
+                    }
+                }
+                else if ((ev.key.code == sf::Keyboard::Comma || ev.key.code == sf::Keyboard::Period) && !renamingFrame && !showResizeDialog)
+                {
+                    // , / . lower / raise the current layer's opacity in 10% steps
+                    Frame &f = canvas.frames[canvas.currentFrame];
+                    if (!f.layers.empty())
+                    {
+                        const pixlayer::Layer &l = f.layers[f.activeLayer];
+                        int percent = (int)std::lround(l.opacity * 100 / 255.0) + (ev.key.code == sf::Keyboard::Period ? 10 : -10);
+                        percent = std::max(0, std::min(100, percent));
+                        f.styleLayer(l.visible, (u8)std::lround(percent * 255 / 100.0), l.blend);
+                    }
+                }
                 else if (ev.key.code == sf::Keyboard::Right)
                 {
                     canvas.nextFrame();
@@ -671,6 +3668,18 @@ int main()
                 {
                     canvas.prevFrame();
                 }
+                else if (ctrl && (ev.key.code == sf::Keyboard::Up || ev.key.code == sf::Keyboard::Down))
+                {
+                    // move the current layer up / down the stack
+                    canvas.frames[canvas.currentFrame].moveLayer(ev.key.code == sf::Keyboard::Up ? 1 : -1);
+                }
+                else if (ev.key.code == sf::Keyboard::Up || ev.key.code == sf::Keyboard::Down)
+                {
+                    // lengthen / shorten the current frame, in 10 ms steps (1 ms with Shift)
+                    Frame &f = canvas.frames[canvas.currentFrame];
+                    int step = (ev.key.shift ? 1 : 10) * (ev.key.code == sf::Keyboard::Up ? 1 : -1);
+                    f.setDuration((unsigned)std::max(0, (int)f.duration + step));
+                }
                 else if (ev.key.code == sf::Keyboard::R && ctrl)
                 {
                     showResizeDialog = !showResizeDialog;
@@ -742,6 +3751,11 @@ int main()
                         widthInputActive = false;
                         heightInputActive = false;
                     }
+                    else if (exportJob && !exportJob->finished)
+                    {
+                        // Cancel the running export
+                        exportJob->cancel();
+                    }
                 }
             }
             else if (ev.type == sf::Event::TextEntered)
@@ -793,11 +3807,11 @@ int main()
         sf::FloatRect canvasArea(8, toolbarH + 8, (float)winSize.x - sidebarW - 24, (float)winSize.y - toolbarH - 16);
 
         // Mouse pos and mapping to canvas coords
-        sf::Vector2i mpos = sf::Mouse::getPosition(window);
+        sf::Vector2i mpos = tape.mouse();
         bool mouseInCanvas = (mpos.x >= (int)canvasArea.left && mpos.x < (int)(canvasArea.left + canvasArea.width) && mpos.y >= (int)canvasArea.top && mpos.y < (int)(canvasArea.top + canvasArea.height));
 
         // Pan with middle drag or spacebar + left drag
-        if (middleMouseDown || (sf::Keyboard::isKeyPressed(sf::Keyboard::Space) && leftMouseDown))
+        if (middleMouseDown || (tape.keyDown(sf::Keyboard::Space) && leftMouseDown))
         {
             sf::Vector2i cur = mpos;
             sf::Vector2f diff((float)(cur.x - lastMouse.x), (float)(cur.y - lastMouse.y));
@@ -806,17 +3820,42 @@ int main()
         }
 
         // Handle color picker clicks
+        colorPicker.sync(canvas.drawColor);
         if (leftMouseDown)
         {
+            Color before = canvas.drawColor;
             if (colorPicker.handleClick(mpos, canvas.drawColor))
             {
                 uiElementClicked = true;
+
+                // Shift+click rewrites the palette slot of the current colour:
+                // in the active variant when previewing one, otherwise in the
+                // real palette (indexed mode), recolouring the whole animation.
+                // The slot is held for the whole drag, so dragging through the
+                // HSV field recolours it live (one palette upload per change)
+                bool shift = tape.keyDown(sf::Keyboard::LShift) || tape.keyDown(sf::Keyboard::RShift);
+                if (shift && (canvas.indexedMode || canvas.activeVariant >= 0))
+                {
+                    if (editingSlot < 0)
+                        editingSlot = canvas.findPaletteIndex(sf::Color(before.r, before.g, before.b, before.a), true);
+                    Color c = canvas.drawColor;
+                    if (editingSlot >= 0 && (c.r != before.r || c.g != before.g || c.b != before.b || c.a != before.a))
+                        canvas.editPaletteSlot((u8)editingSlot, sf::Color(c.r, c.g, c.b, c.a));
+                }
             }
         }
+        else
+        {
+            colorPicker.release();
+            editingSlot = -1;
+        }
+        previewTime += dt;
+        paletteShader.sync(canvas, previewTime);
 
         // Drawing: convert mouse to pixel coords
         if (leftMouseDown && mouseInCanvas && !uiElementClicked && !colorPicker.isOpen && !showResizeDialog && !renamingFrame)
         {
+            pixprof::Scope toolScope(pixprof::PHASE_TOOLS);
             // map mouse to canvas pixel position
             float localX = (mpos.x - canvasArea.left - canvas.pan.x) / canvas.zoom;
             float localY = (mpos.y - canvasArea.top - canvas.pan.y) / canvas.zoom;
@@ -841,19 +3880,20 @@ int main()
                 }
             }
         }
+        canvas.flattenEdits();
 
-        // simple animation playback
-        if (playing && canvas.frames.size() > 1)
-        {
-            playTimer += dt;
-            if (playTimer >= 1.0f / fps)
-            {
-                playTimer = 0;
-                canvas.nextFrame();
-            }
-        }
+        // animation playback, at each frame's own duration, with the
+        // frames coming up uploaded ahead of time
+        playback.update(dt, canvas);
+        playback.prefetch(canvas);
+
+        // finished background jobs report back, stale thumbnails rebuild
+        pixjobs::pool().runCompletions();
+        canvas.refreshThumbnails();
+        autosave.tick(canvas, dt);
 
         // --- Rendering with 8-bit style ---
+        pixprof::phase(pixprof::PHASE_UI);
         window.clear(sf::Color(EightBitColors::DarkPurple.r, EightBitColors::DarkPurple.g, EightBitColors::DarkPurple.b)); // 8-bit background
 
         // Draw main panels with 8-bit style
@@ -952,58 +3992,73 @@ int main()
         }
 
         // Draw canvas background (8-bit style checkerboard)
+        pixprof::phase(pixprof::PHASE_CANVAS);
         sf::RectangleShape canvasBg({canvasArea.width, canvasArea.height});
         canvasBg.setPosition(canvasArea.left, canvasArea.top);
         canvasBg.setFillColor(sf::Color(EightBitColors::Black.r, EightBitColors::Black.g, EightBitColors::Black.b));
         window.draw(canvasBg);
 
-        // Get current frame image & draw scaled by zoom and pan
-        sf::Image comp = canvas.getCurrentFrameImage();
-
-        // onion skin: draw previous frame with low alpha behind
-        if (canvas.onionSkin && canvas.frames.size() > 1)
+        // Draw the current frame scaled by zoom and pan from its cached texture
+        // (indexed frames hold indices and expand on the GPU). RGBA frames
+        // come from a mip level instead below 1x, so they don't alias, and
+        // while scrubbing onto a frame whose texture is stale, so only a
+        // small proxy is uploaded until the frame settles. Onion skinning
+        // composites full-resolution textures, so it always uses level 0.
+        // Only the pixels inside the canvas area are drawn, uploaded and
+        // gridded, so the cost follows the window size, not the canvas's.
+        const Frame &curFrame = canvas.frames[canvas.currentFrame];
+        sf::Vector2f origin(canvasArea.left + canvas.pan.x, canvasArea.top + canvas.pan.y);
+        sf::IntRect visible = canvas.visibleRect(canvasArea);
+        bool onion = canvas.onionSkin && canvas.frames.size() > 1;
+        unsigned level = 0;
+        if (!curFrame.indexed && !onion)
         {
-            int prev = (canvas.currentFrame - 1 + canvas.frames.size()) % canvas.frames.size();
-            // draw prev frame under comp
-            sf::Texture pt;
-            pt.loadFromImage(canvas.frames[prev].image);
-            sf::Sprite ps(pt);
-            ps.setScale(canvas.zoom, canvas.zoom);
-            ps.setPosition(canvasArea.left + canvas.pan.x, canvasArea.top + canvas.pan.y);
-            ps.setColor(sf::Color(255, 255, 255, 100)); // semi-transparent
-            window.draw(ps);
+            const pixmip::Chain &chain = curFrame.mipChain();
+            if (canvas.zoom < 1.f)
+                level = (unsigned)std::floor(std::log2(1.f / canvas.zoom));
+            bool scrubbing = canvas.currentFrame != shownFrame && !playback.playing && !curFrame.textureCurrent();
+            if (scrubbing)
+                level = std::max(level, chain.levelFor(MipView::PROXY_SIZE, MipView::PROXY_SIZE));
+            level = std::min(level, (unsigned)chain.levels());
         }
-
-        sf::Texture tex;
-        tex.create(canvas.width, canvas.height);
-        tex.update(comp);
-        sf::Sprite sprite(tex);
-        sprite.setScale(canvas.zoom, canvas.zoom);
-        sprite.setPosition(canvasArea.left + canvas.pan.x, canvasArea.top + canvas.pan.y);
-        window.draw(sprite);
-
-        // Optionally draw grid lines with 8-bit color
-        if (canvas.showGrid)
+        shownFrame = canvas.currentFrame;
+        if (visible.width > 0)
         {
-            sf::VertexArray lines(sf::Lines);
-            for (unsigned xg = 0; xg <= canvas.width; ++xg)
+            sf::Sprite sprite;
+            if (level)
             {
-                float sxp = canvasArea.left + canvas.pan.x + xg * canvas.zoom;
-                lines.append(sf::Vertex({sxp, canvasArea.top + canvas.pan.y},
-                                        sf::Color(EightBitColors::DarkGray.r, EightBitColors::DarkGray.g, EightBitColors::DarkGray.b)));
-                lines.append(sf::Vertex({sxp, canvasArea.top + canvas.pan.y + canvas.height * canvas.zoom},
-                                        sf::Color(EightBitColors::DarkGray.r, EightBitColors::DarkGray.g, EightBitColors::DarkGray.b)));
+                // the visible rectangle in level texels, rounded outwards
+                const pixmip::Level &lv = curFrame.mipChain().level(level);
+                float sx = canvas.zoom * canvas.width / lv.width, sy = canvas.zoom * canvas.height / lv.height;
+                int lx0 = visible.left * (int)lv.width / (int)canvas.width;
+                int ly0 = visible.top * (int)lv.height / (int)canvas.height;
+                int lx1 = ((visible.left + visible.width) * (int)lv.width + (int)canvas.width - 1) / (int)canvas.width;
+                int ly1 = ((visible.top + visible.height) * (int)lv.height + (int)canvas.height - 1) / (int)canvas.height;
+                sprite.setTexture(mipView.texture(curFrame, level));
+                sprite.setTextureRect(sf::IntRect(lx0, ly0, lx1 - lx0, ly1 - ly0));
+                sprite.setScale(sx, sy);
+                sprite.setPosition(origin.x + lx0 * sx, origin.y + ly0 * sy);
             }
-            for (unsigned yg = 0; yg <= canvas.height; ++yg)
+            else
             {
-                float syp = canvasArea.top + canvas.pan.y + yg * canvas.zoom;
-                lines.append(sf::Vertex({canvasArea.left + canvas.pan.x, syp},
-                                        sf::Color(EightBitColors::DarkGray.r, EightBitColors::DarkGray.g, EightBitColors::DarkGray.b)));
-                lines.append(sf::Vertex({canvasArea.left + canvas.pan.x + canvas.width * canvas.zoom, syp},
-                                        sf::Color(EightBitColors::DarkGray.r, EightBitColors::DarkGray.g, EightBitColors::DarkGray.b)));
+                sprite.setTexture(curFrame.texture(visible));
+                sprite.setTextureRect(visible);
+                sprite.setScale(canvas.zoom, canvas.zoom);
+                sprite.setPosition(origin.x + visible.left * canvas.zoom, origin.y + visible.top * canvas.zoom);
             }
-            window.draw(lines);
+
+            // onion skin: neighbouring frames composited underneath in one pass
+            if (onion)
+                onionSkin.draw(window, canvas, sprite, paletteShader);
+            else
+                window.draw(sprite, paletteShader.statesFor(curFrame));
+
+            // Optionally draw grid lines with 8-bit color (not below 1x,
+            // where they would be denser than the pixels)
+            if (canvas.showGrid && canvas.zoom >= 1.f)
+                gridOverlay.draw(window, origin, canvas.zoom, visible);
         }
+        pixprof::phase(pixprof::PHASE_UI);
 
         // Sidebar area (frames)
         sf::FloatRect sidebar(canvasArea.left + canvasArea.width + 8, 4, sidebarW - 8, (float)winSize.y - 8);
@@ -1014,10 +4069,10 @@ int main()
         // Play/Stop button with hover
         bool playBtnHovered = (mpos.x >= (int)(sidebar.left + 8) && mpos.x <= (int)(sidebar.left + 68) &&
                                mpos.y >= (int)controlY && mpos.y <= (int)(controlY + 28));
-        drawButton(window, sf::FloatRect(sidebar.left + 8, controlY, 60, 28), font, playing ? "STOP" : "PLAY", playing, playBtnHovered);
+        drawButton(window, sf::FloatRect(sidebar.left + 8, controlY, 60, 28), font, playback.playing ? "STOP" : "PLAY", playback.playing, playBtnHovered);
         if (leftMouseDown && playBtnHovered)
         {
-            playing = !playing;
+            playback.toggle();
             uiElementClicked = true;
         }
 
@@ -1075,7 +4130,7 @@ int main()
             thumbBorder.setOutlineThickness(1);
             window.draw(thumbBorder);
 
-            window.draw(thumb);
+            window.draw(thumb, paletteShader.statesFor(canvas.frames[i]));
 
             // Draw frame info
             if (renamingFrame && frameToRename == (int)i)
@@ -1114,7 +4169,7 @@ int main()
             // Handle frame selection and controls
             if (leftMouseDown && !uiElementClicked && !renamingFrame)
             {
-                sf::Vector2i mm = sf::Mouse::getPosition(window);
+                sf::Vector2i mm = tape.mouse();
                 if (mm.x >= (int)r.left && mm.x <= (int)(r.left + r.width) && mm.y >= (int)r.top && mm.y <= (int)(r.top + r.height))
                 {
                     // Check which part was clicked
@@ -1263,7 +4318,7 @@ int main()
             // Handle resize dialog clicks
             if (leftMouseDown && !uiElementClicked)
             {
-                sf::Vector2i mm = sf::Mouse::getPosition(window);
+                sf::Vector2i mm = tape.mouse();
 
                 // Check width input click
                 sf::FloatRect widthInputRect(dialogPos.x + 80, dialogPos.y + 40, 80, 25);
@@ -1330,15 +4385,52 @@ int main()
         std::string toolName = canvas.currentTool == Tool::Pencil ? "PENCIL" : canvas.currentTool == Tool::Eraser ? "ERASER"
                                                                                                                   : "FILL";
         sf::Text status("TOOL: " + toolName + "  FRAME: " + std::to_string(canvas.currentFrame) +
-                            "  ZOOM: " + std::to_string((int)canvas.zoom) + "x",
+                            " (" + std::to_string(canvas.frames[canvas.currentFrame].duration) + "ms)" +
+                            (playback.playing ? "  DROPPED " + std::to_string(playback.dropped) : std::string()) +
+                            "  ZOOM: " + (canvas.zoom >= 1.f ? std::to_string((int)canvas.zoom) : "1/" + std::to_string((int)std::lround(1.f / canvas.zoom))) + "x" +
+                            "  EXPORT: " + std::to_string(canvas.exportScale) + "x " + pixup::modeName(canvas.exportMode) +
+                            "  HEADER: " + pixcexport::formatName(canvas.headerFormat) + (canvas.headerRLE ? " RLE" : "") +
+                            (canvas.indexedMode ? "  INDEXED " + std::to_string(canvas.palette.size()) : std::string()) +
+                            (canvas.activeVariant >= 0 ? "  VARIANT " + std::to_string(canvas.activeVariant + 1) : std::string()) +
+                            (canvas.colorCycling ? "  CYCLE " + std::to_string(canvas.cycleFirst) + "-" + std::to_string(canvas.cycleLast) : std::string()) +
+                            layerStatus(canvas.frames[canvas.currentFrame]) +
+                            (canvas.onionSkin ? "  ONION -" + std::to_string(canvas.onionPrev) + "/+" + std::to_string(canvas.onionNext) : std::string()) +
+                            (saveJob && !saveJob->finished ? "  SAVING" : std::string()) +
+                            (importJob && !importJob->finished ? "  IMPORTING" : std::string()) +
+                            (exportJob && !exportJob->finished ? "  EXPORTING " + std::to_string((int)(exportJob->progress * 100)) + "%" : std::string()),
                         font, 12);
         status.setStyle(sf::Text::Bold);
         status.setPosition(8, winSize.y - 22);
         status.setFillColor(sf::Color(EightBitColors::Yellow.r, EightBitColors::Yellow.g, EightBitColors::Yellow.b));
         window.draw(status);
 
+        if (pixprof::profiler().visible)
+            drawProfilerHud(window, font);
+
+        pixprof::phase(pixprof::PHASE_PRESENT);
         window.display();
     } // main loop
 
+    autosave.shutdown(canvas);
+
+    if (replaying)
+    {
+        pixprof::profiler().frame();
+        std::cout << "Replayed " << tape.ticks << " ticks\n"
+                  << pixprof::profiler().totals();
+        char hash[32];
+        std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)canvas.contentHash());
+        std::cout << "canvas hash " << hash << "\n";
+    }
+    else if (tape.mode == InputTape::Record)
+        std::cout << "Recorded " << tape.ticks << " ticks\n";
+
+    if (pixtrace::enabled())
+    {
+        pixtrace::stop();
+        if (pixtrace::dump("trace.json"))
+            std::cout << "Wrote trace.json\n";
+    }
+
     return 0;
 }
\ No newline at end of file